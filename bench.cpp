@@ -0,0 +1,253 @@
+#include "obj-to-js-array.h"
+
+#include <chrono>
+#include <iostream>
+#include <string>
+#include <string_view>
+#include <vector>
+#include <unordered_map>
+#include <algorithm>
+#include <charconv>
+#include <limits>
+#include <thread>
+#include <memory_resource>
+
+#include <fcntl.h>
+#include <unistd.h>
+
+// Shape of the synthetic mesh
+struct MeshSpec {
+    unsigned int size = 500; // The grid has size x size faces
+    bool quads = true;       // Quads, or pairs of triangles
+    bool texcoords = true;
+    bool normals = true;
+    bool highReuse = true;   // Share the corners of neighbouring faces
+};
+
+// Appends the number followed by the separator
+template <typename T>
+void appendNumber(std::string& out, T value, char separator)
+{
+    char buffer[32];
+    char* end = std::to_chars(buffer, buffer + sizeof(buffer), value).ptr;
+    out.append(buffer, end);
+    out.push_back(separator);
+}
+
+// Generates a height field grid as .obj text. With high reuse every grid
+// point is one vertex shared by up to four faces, with low reuse every face
+// has attributes of its own, so nothing deduplicates.
+std::string generateObj(const MeshSpec& spec)
+{
+    unsigned int n = spec.size, points = (n + 1) * (n + 1);
+    unsigned int count = spec.highReuse ? points : 4 * n * n;
+    std::string out;
+    out.reserve(size_t(count) * (spec.texcoords ? 60 : 40) + size_t(n) * n * 2 * 40);
+
+    // Gets the grid point of a numbered attribute
+    auto pointOf = [&](unsigned int k, unsigned int& i, unsigned int& j) {
+        if (spec.highReuse) {
+            i = k % (n + 1); j = k / (n + 1);
+        } else {
+            // Corners 0-3 of face k / 4
+            static const unsigned int di[] = {0, 1, 1, 0}, dj[] = {0, 0, 1, 1};
+            i = (k / 4) % n + di[k % 4]; j = (k / 4) / n + dj[k % 4];
+        }
+    };
+    auto height = [](unsigned int i, unsigned int j) {
+        uint32_t h = (i * 73856093u) ^ (j * 19349663u);
+        h = (h ^ (h >> 13)) * 0x5bd1e995u;
+        return float(h >> 8) / float(1 << 24) * 0.1f;
+    };
+
+    out += "# Synthetic mesh\n";
+    unsigned int i, j;
+    for (unsigned int k = 0; k < count; ++k) {
+        pointOf(k, i, j);
+        out += "v ";
+        appendNumber(out, float(i) / n, ' ');
+        appendNumber(out, height(i, j), ' ');
+        appendNumber(out, float(j) / n, '\n');
+    }
+    for (unsigned int k = 0; spec.texcoords && k < count; ++k) {
+        pointOf(k, i, j);
+        out += "vt ";
+        appendNumber(out, float(i) / n, ' ');
+        appendNumber(out, float(j) / n, '\n');
+    }
+    for (unsigned int k = 0; spec.normals && k < count; ++k) {
+        pointOf(k, i, j);
+        out += "vn ";
+        appendNumber(out, height(i + 1, j) - height(i, j), ' ');
+        out += "1 ";
+        appendNumber(out, height(i, j + 1) - height(i, j), '\n');
+    }
+
+    // Writes a face vertex referencing attribute k
+    auto corner = [&](unsigned int k, char separator) {
+        ++k;
+        if (spec.texcoords && spec.normals) {
+            appendNumber(out, k, '/'); appendNumber(out, k, '/'); appendNumber(out, k, separator);
+        } else if (spec.texcoords) {
+            appendNumber(out, k, '/'); appendNumber(out, k, separator);
+        } else if (spec.normals) {
+            appendNumber(out, k, '/'); out.push_back('/'); appendNumber(out, k, separator);
+        } else {
+            appendNumber(out, k, separator);
+        }
+    };
+    for (unsigned int f = 0; f < n * n; ++f) {
+        unsigned int c[4];
+        if (spec.highReuse) {
+            unsigned int fi = f % n, fj = f / n;
+            c[0] = fj * (n + 1) + fi; c[1] = c[0] + 1;
+            c[3] = c[0] + n + 1; c[2] = c[3] + 1;
+        } else {
+            for (unsigned int k = 0; k < 4; ++k)
+                c[k] = 4 * f + k;
+        }
+        if (spec.quads) {
+            out += "f ";
+            corner(c[0], ' '); corner(c[1], ' '); corner(c[2], ' '); corner(c[3], '\n');
+        } else {
+            out += "f ";
+            corner(c[0], ' '); corner(c[1], ' '); corner(c[2], '\n');
+            out += "f ";
+            corner(c[0], ' '); corner(c[2], ' '); corner(c[3], '\n');
+        }
+    }
+    return out;
+}
+
+// Best time over all repetitions of a stage
+struct StageTime {
+    double seconds = std::numeric_limits<double>::infinity();
+    void add(double s) { seconds = std::min(seconds, s); }
+};
+
+// Times every stage of the conversion and prints a JSON summary
+template <typename Real>
+int runBenchmark(const MeshSpec& spec, std::string_view text, unsigned int threads,
+                 unsigned int repeat, bool binary, bool reuse)
+{
+    typedef std::chrono::steady_clock Clock;
+    auto since = [](Clock::time_point start) {
+        return std::chrono::duration<double>(Clock::now() - start).count();
+    };
+
+    int sink = ::open("/dev/null", O_WRONLY);
+    if (sink < 0) {
+        std::cerr << "Could not open /dev/null" << std::endl;
+        return -1;
+    }
+
+    // A reused context keeps its pooled buffers between repetitions, like a
+    // long-running process converting one mesh after another
+    std::pmr::unsynchronized_pool_resource pool;
+    ParseContext<Real> context(&pool);
+
+    StageTime parse, sort, emit;
+    size_t vertices = 0, indices = 0, outputBytes = 0;
+    for (unsigned int r = 0; r < repeat; ++r) {
+        VertexBuffer<Real> vbo;
+        std::vector<unsigned int> ebo;
+
+        Clock::time_point start = Clock::now();
+        if (!objToJs(text, vbo, ebo, !spec.texcoords, !spec.normals, threads, 0,
+                     reuse ? &context : 0)) {
+            ::close(sink);
+            return -1;
+        }
+        parse.add(since(start));
+
+        start = Clock::now();
+        sortZX(vbo, ebo, threads);
+        sort.add(since(start));
+
+        start = Clock::now();
+        OutputBuffer output(sink);
+        if (binary)
+            writeBinary(output, vbo, ebo);
+        else
+            writeArrays(output, vbo, ebo, "", 5, threads);
+        output.flush();
+        emit.add(since(start));
+
+        vertices = vbo.size();
+        indices = ebo.size();
+        outputBytes = output.bytesWritten();
+    }
+    ::close(sink);
+
+    auto stage = [&](const char* name, const StageTime& time, size_t bytes, bool last) {
+        std::cout << "    \"" << name << "\": {\"seconds\": " << time.seconds;
+        if (bytes)
+            std::cout << ", \"MBps\": " << bytes / 1e6 / time.seconds;
+        std::cout << ", \"verticesPerSecond\": " << vertices / time.seconds << "}"
+                  << (last ? "\n" : ",\n");
+    };
+    std::cout << "{\n"
+              << "  \"mesh\": {\"faces\": " << size_t(spec.size) * spec.size * (spec.quads ? 1 : 2)
+              << ", \"quads\": " << (spec.quads ? "true" : "false")
+              << ", \"texcoords\": " << (spec.texcoords ? "true" : "false")
+              << ", \"normals\": " << (spec.normals ? "true" : "false")
+              << ", \"reuse\": \"" << (spec.highReuse ? "high" : "low") << "\""
+              << ", \"inputBytes\": " << text.size()
+              << ", \"outputBytes\": " << outputBytes
+              << ", \"vertices\": " << vertices
+              << ", \"indices\": " << indices << "},\n"
+              << "  \"threads\": " << threads << ",\n"
+              << "  \"repeat\": " << repeat << ",\n"
+              << "  \"reuseContext\": " << (reuse ? "true" : "false") << ",\n"
+              << "  \"stages\": {\n";
+    stage("objToJs", parse, text.size(), false);
+    stage("sortZX", sort, 0, false);
+    stage("emit", emit, outputBytes, true);
+    std::cout << "  }\n}" << std::endl;
+    return 0;
+}
+
+int main(int argc, char* argv[])
+{
+    // Parse arguments
+    std::unordered_map<std::string, Argument> parsedArgs;
+    parseArguments(parsedArgs, argc, argv);
+
+    MeshSpec spec;
+    if (parsedArgs.count("--size"))
+        spec.size = std::max(1, parsedArgs["--size"].value);
+    spec.quads = !parsedArgs.count("--triangles");
+    spec.texcoords = !parsedArgs.count("--no-texture");
+    spec.normals = !parsedArgs.count("--no-normal");
+    spec.highReuse = !parsedArgs.count("--low-reuse");
+    int threads = parsedArgs.count("--threads") ? parsedArgs["--threads"].value : 1;
+    if (threads <= 0)
+        threads = std::max(1u, std::thread::hardware_concurrency());
+    unsigned int repeat = parsedArgs.count("--repeat") ? std::max(1, parsedArgs["--repeat"].value) : 3;
+    bool binary = parsedArgs.count("--format") && parsedArgs["--format"].text == "bin";
+    bool reuse = parsedArgs.count("--reuse-context");
+
+    std::string text = generateObj(spec);
+
+    // Optionally keep the generated mesh for timing the command line tool
+    if (parsedArgs.count("--save")) {
+        const std::string& path = parsedArgs["--save"].text;
+        int fd = ::open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0666);
+        if (fd < 0) {
+            std::cerr << "Could not open file " << path << std::endl;
+            return -1;
+        }
+        OutputBuffer out(fd);
+        out.write(text);
+        bool ok = out.flush();
+        ok = ::close(fd) == 0 && ok;
+        if (!ok) {
+            std::cerr << "Could not write file " << path << std::endl;
+            return -1;
+        }
+    }
+
+    return parsedArgs.count("--double")
+        ? runBenchmark<double>(spec, text, threads, repeat, binary, reuse)
+        : runBenchmark<float>(spec, text, threads, repeat, binary, reuse);
+}
@@ -0,0 +1,75 @@
+#include "obj-to-js-array.h"
+
+#include <cstdint>
+#include <cstring>
+#include <sstream>
+#include <string_view>
+#include <vector>
+
+// libFuzzer entry point: parses the input with the sequential and parallel
+// parsers, which must agree, and with attributes left out, checks the
+// indices of whatever parsed and runs it through the post-processing passes,
+// simplification and writers. Build with `make fuzz` and run
+// ./objtoarr-fuzz CORPUS_DIR.
+extern "C" int LLVMFuzzerTestOneInput(const uint8_t* data, size_t size)
+{
+    std::string_view text(reinterpret_cast<const char*>(data), size);
+    // One context for all inputs, so clearing it between meshes is tested too
+    static ParseContext<float> context;
+    std::ostringstream log;
+    context.log = &log;
+
+    VertexBuffer<float> sequentialVbo;
+    std::vector<unsigned int> sequentialEbo;
+    bool sequential = objToJs(text, sequentialVbo, sequentialEbo, false, false, 1, 0, &context);
+    for (unsigned int mode = 0; mode < 4; ++mode) {
+        VertexBuffer<float> vbo;
+        std::vector<unsigned int> ebo;
+        bool disableTexture = mode == 2, disableNormal = mode == 3;
+        unsigned int threads = mode == 1 ? 3 : 1;
+        bool parsed = mode == 0
+            ? (vbo = sequentialVbo, ebo = sequentialEbo, sequential)
+            : objToJs(text, vbo, ebo, disableTexture, disableNormal, threads, 0, &context);
+        if (mode == 1) {
+            // Vertex data is compared bytewise, as NaN is not equal to itself
+            bool same = parsed == sequential;
+            if (same && parsed) {
+                same = ebo == sequentialEbo && vbo.data.size() == sequentialVbo.data.size()
+                    && (vbo.data.empty() || std::memcmp(vbo.data.data(), sequentialVbo.data.data(),
+                                                        vbo.data.size() * sizeof(float)) == 0);
+            }
+            if (!same)
+                __builtin_trap();
+        }
+        if (!parsed)
+            continue;
+        if (ebo.size() % 3)
+            __builtin_trap();
+        for (unsigned int i : ebo) {
+            if (i >= vbo.size())
+                __builtin_trap();
+        }
+
+        OutputBuffer out;
+        writeArrays(out, vbo, ebo, "", 5, threads);
+        writeBinary(out, vbo, ebo);
+        if (mode == 0) {
+            generateNormals(vbo, ebo, 45);
+            weldVertices(vbo, ebo, 0.01);
+            std::vector<std::vector<unsigned int>> lods = buildLods(vbo, ebo, {0.5, 0.1});
+            for (const std::vector<unsigned int>& lod : lods) {
+                for (unsigned int i : lod) {
+                    if (i >= vbo.size())
+                        __builtin_trap();
+                }
+            }
+            writeLods(out, lods, "", threads);
+            writeBinaryLods(out, vbo, lods, true);
+            std::vector<Meshlet> meshlets = buildMeshlets(vbo, ebo, 16, 8);
+            writeMeshlets(out, meshlets, "", 5);
+            Quantization quantization = quantizationBounds(vbo, TexcoordUnorm16);
+            writeBinary(out, vbo, ebo, &quantization, true);
+        }
+    }
+    return 0;
+}
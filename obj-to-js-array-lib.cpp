@@ -0,0 +1,1293 @@
+// Out-of-line parts of the obj-to-js-array library, and the float and
+// double instantiations of its entry points
+#include "obj-to-js-array.h"
+
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#ifdef OBJTOARR_ZLIB
+#include <zlib.h>
+#endif
+#ifdef OBJTOARR_ZSTD
+#include <zstd.h>
+#endif
+
+bool compressionSupported(Compression compression)
+{
+    switch (compression) {
+    case CompressionNone:
+        return true;
+    case CompressionGzip:
+#ifdef OBJTOARR_ZLIB
+        return true;
+#else
+        return false;
+#endif
+    case CompressionZstd:
+#ifdef OBJTOARR_ZSTD
+        return true;
+#else
+        return false;
+#endif
+    }
+    return false;
+}
+
+bool InputBuffer::open(const char* path)
+{
+    release();
+    int fd = ::open(path, O_RDONLY);
+    if (fd < 0)
+        return false;
+    struct stat st;
+    bool ok = fstat(fd, &st) == 0;
+    if (ok && S_ISREG(st.st_mode) && st.st_size > 0) {
+        void* p = mmap(0, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (p != MAP_FAILED) {
+            madvise(p, st.st_size, MADV_SEQUENTIAL);
+            mapped = static_cast<const char*>(p);
+            mappedSize = st.st_size;
+            ::close(fd);
+            return true;
+        }
+    }
+    // Not mappable, read it instead
+    ok = ok && read(fd);
+    ::close(fd);
+    return ok;
+}
+
+bool InputBuffer::read(int fd)
+{
+    release();
+    size_t used = 0;
+    buffer.resize(1 << 16);
+    for (;;) {
+        if (used == buffer.size())
+            buffer.resize(buffer.size() * 2);
+        ssize_t n = ::read(fd, &buffer[used], buffer.size() - used);
+        if (n == 0)
+            break;
+        if (n < 0) {
+            if (errno == EINTR)
+                continue;
+            return false;
+        }
+        used += n;
+    }
+    buffer.resize(used);
+    return true;
+}
+
+bool InputBuffer::read(int fd, size_t size)
+{
+    release();
+    // Grows with what arrives rather than trusting the size up front
+    size_t used = 0;
+    while (used < size) {
+        if (used == buffer.size())
+            buffer.resize(std::min(size, std::max<size_t>(2 * used, 1 << 16)));
+        ssize_t n = ::read(fd, &buffer[used], buffer.size() - used);
+        if (n == 0)
+            return false;
+        if (n < 0) {
+            if (errno == EINTR)
+                continue;
+            return false;
+        }
+        used += n;
+    }
+    buffer.resize(used);
+    return true;
+}
+
+const char* InputBuffer::decompress()
+{
+    std::string_view input = view();
+    Compression compression = detectCompression(input);
+    if (compression == CompressionNone)
+        return 0;
+    if (!compressionSupported(compression))
+        return compression == CompressionGzip ? "gzip input needs a build with zlib (ZLIB=1)"
+                                              : "zstd input needs a build with libzstd (ZSTD=1)";
+    std::vector<char> output;
+    bool ok = false;
+#ifdef OBJTOARR_ZLIB
+    if (compression == CompressionGzip) {
+        // The trailer holds the size of the last member modulo 2^32
+        uint32_t hint = 0;
+        if (input.size() >= 4)
+            std::memcpy(&hint, input.data() + input.size() - 4, 4);
+        output.resize(std::max<size_t>(hint, 4 * input.size()) + 1);
+        z_stream z = {};
+        // Detect the gzip header and read every concatenated member
+        if (inflateInit2(&z, 15 + 32) != Z_OK)
+            return "Could not decompress gzip input";
+        z.next_in = reinterpret_cast<Bytef*>(const_cast<char*>(input.data()));
+        size_t produced = 0;
+        int result = Z_OK;
+        for (;;) {
+            size_t left = input.size() - (reinterpret_cast<const char*>(z.next_in) - input.data());
+            if (result == Z_STREAM_END) {
+                if (!left) {
+                    ok = true;
+                    break;
+                }
+                inflateReset(&z);
+            }
+            if (produced == output.size())
+                output.resize(2 * output.size());
+            z.avail_in = static_cast<uInt>(std::min<size_t>(left, 1u << 30));
+            z.next_out = reinterpret_cast<Bytef*>(&output[produced]);
+            z.avail_out = static_cast<uInt>(std::min<size_t>(output.size() - produced, 1u << 30));
+            uInt before = z.avail_out;
+            result = inflate(&z, Z_NO_FLUSH);
+            produced += before - z.avail_out;
+            if (result != Z_OK && result != Z_STREAM_END && !(result == Z_BUF_ERROR && !z.avail_out))
+                break;
+        }
+        inflateEnd(&z);
+        output.resize(produced);
+    }
+#endif
+#ifdef OBJTOARR_ZSTD
+    if (compression == CompressionZstd) {
+        unsigned long long hint = ZSTD_getFrameContentSize(input.data(), input.size());
+        bool known = hint != ZSTD_CONTENTSIZE_UNKNOWN && hint != ZSTD_CONTENTSIZE_ERROR;
+        output.resize(std::max<size_t>(known ? hint : 0, 4 * input.size()) + 1);
+        ZSTD_DCtx* context = ZSTD_createDCtx();
+        ZSTD_inBuffer in = {input.data(), input.size(), 0};
+        size_t produced = 0, result = 0;
+        while (context && in.pos < in.size) {
+            if (produced == output.size())
+                output.resize(2 * output.size());
+            ZSTD_outBuffer out = {&output[produced], output.size() - produced, 0};
+            result = ZSTD_decompressStream(context, &out, &in);
+            produced += out.pos;
+            if (ZSTD_isError(result))
+                break;
+        }
+        ok = context && !ZSTD_isError(result) && result == 0;
+        ZSTD_freeDCtx(context);
+        output.resize(produced);
+    }
+#endif
+    if (!ok)
+        return "Corrupt or truncated compressed input";
+    release();
+    buffer.swap(output);
+    return 0;
+}
+
+void InputBuffer::release()
+{
+    if (mapped)
+        munmap(const_cast<char*>(mapped), mappedSize);
+    mapped = 0;
+    mappedSize = 0;
+    buffer.clear();
+}
+
+// What the compressor thread shares with the writing thread
+struct StreamCompressor::State {
+    int fd;
+    Compression compression;
+    std::mutex mutex;
+    std::condition_variable changed;
+    std::deque<std::pair<std::vector<char>, size_t>> queue; // Blocks to compress
+    std::vector<std::vector<char>> spare;                    // Compressed blocks to reuse
+    bool open = true; // Whether the stream has to be ended
+    bool ending = false, stopping = false, failed = false;
+    std::thread worker;
+
+    std::vector<char> output = std::vector<char>(1 << 18);
+#ifdef OBJTOARR_ZLIB
+    z_stream z = {};
+#endif
+#ifdef OBJTOARR_ZSTD
+    ZSTD_CCtx* context = 0;
+#endif
+
+    // Writes all compressed bytes of the output buffer
+    void write(size_t size)
+    {
+        const char* data = output.data();
+        while (size > 0 && !failed) {
+            ssize_t n = ::write(fd, data, size);
+            if (n < 0) {
+                failed = errno != EINTR;
+                continue;
+            }
+            data += n;
+            size -= n;
+        }
+    }
+
+    // Compresses the bytes, or ends the stream when end is set
+    void compress(const char* data, size_t size, bool end)
+    {
+#ifdef OBJTOARR_ZLIB
+        if (compression == CompressionGzip) {
+            z.next_in = reinterpret_cast<Bytef*>(const_cast<char*>(data));
+            z.avail_in = static_cast<uInt>(size);
+            int result;
+            do {
+                z.next_out = reinterpret_cast<Bytef*>(output.data());
+                z.avail_out = static_cast<uInt>(output.size());
+                result = deflate(&z, end ? Z_FINISH : Z_NO_FLUSH);
+                failed = failed || result == Z_STREAM_ERROR;
+                write(output.size() - z.avail_out);
+            } while (!failed && (z.avail_out == 0 || (end && result != Z_STREAM_END)));
+            if (end)
+                deflateReset(&z);
+        }
+#endif
+#ifdef OBJTOARR_ZSTD
+        if (compression == CompressionZstd) {
+            ZSTD_inBuffer in = {data, size, 0};
+            size_t remaining;
+            do {
+                ZSTD_outBuffer out = {output.data(), output.size(), 0};
+                remaining = ZSTD_compressStream2(context, &out, &in, end ? ZSTD_e_end : ZSTD_e_continue);
+                failed = failed || ZSTD_isError(remaining);
+                write(out.pos);
+            } while (!failed && (in.pos < in.size || (end && remaining > 0)));
+        }
+#endif
+        failed = failed || !compressionSupported(compression);
+    }
+
+    void run()
+    {
+        std::unique_lock<std::mutex> lock(mutex);
+        for (;;) {
+            changed.wait(lock, [this] { return !queue.empty() || ending || stopping; });
+            if (!queue.empty()) {
+                std::pair<std::vector<char>, size_t> block = std::move(queue.front());
+                queue.pop_front();
+                lock.unlock();
+                compress(block.first.data(), block.second, false);
+                lock.lock();
+                spare.push_back(std::move(block.first));
+            } else if (ending) {
+                lock.unlock();
+                compress(0, 0, true);
+                lock.lock();
+                ending = open = false;
+            } else {
+                break;
+            }
+            changed.notify_all();
+        }
+    }
+};
+
+StreamCompressor::StreamCompressor(int fd, Compression compression)
+    : state(new State)
+{
+    state->fd = fd;
+    state->compression = compression;
+#ifdef OBJTOARR_ZLIB
+    // A gzip header and trailer around the deflate stream
+    if (compression == CompressionGzip)
+        state->failed = deflateInit2(&state->z, Z_DEFAULT_COMPRESSION, Z_DEFLATED, 15 + 16, 8,
+                                     Z_DEFAULT_STRATEGY) != Z_OK;
+#endif
+#ifdef OBJTOARR_ZSTD
+    if (compression == CompressionZstd) {
+        state->context = ZSTD_createCCtx();
+        state->failed = !state->context;
+    }
+#endif
+    state->worker = std::thread(&State::run, state.get());
+}
+
+StreamCompressor::~StreamCompressor()
+{
+    {
+        std::lock_guard<std::mutex> lock(state->mutex);
+        state->stopping = true;
+    }
+    state->changed.notify_all();
+    state->worker.join();
+#ifdef OBJTOARR_ZLIB
+    if (state->compression == CompressionGzip)
+        deflateEnd(&state->z);
+#endif
+#ifdef OBJTOARR_ZSTD
+    ZSTD_freeCCtx(state->context);
+#endif
+}
+
+void StreamCompressor::submit(std::vector<char>& block, size_t size)
+{
+    std::unique_lock<std::mutex> lock(state->mutex);
+    state->changed.wait(lock, [this] { return state->queue.size() < 2; });
+    size_t capacity = block.size();
+    state->queue.emplace_back(std::move(block), size);
+    state->open = true;
+    if (!state->spare.empty()) {
+        block = std::move(state->spare.back());
+        state->spare.pop_back();
+    }
+    block.resize(capacity);
+    state->changed.notify_all();
+}
+
+bool StreamCompressor::finish()
+{
+    std::unique_lock<std::mutex> lock(state->mutex);
+    state->ending = state->open;
+    state->changed.notify_all();
+    state->changed.wait(lock, [this] { return state->queue.empty() && !state->ending; });
+    return !state->failed;
+}
+
+void OutputBuffer::reopen(int newFd)
+{
+    flush();
+    compressor.reset();
+    fd = newFd;
+    written = 0;
+    failed = false;
+}
+
+void OutputBuffer::compress(Compression compression)
+{
+    flush();
+    compressor.reset();
+    if (compression != CompressionNone && !inMemory)
+        compressor.reset(new StreamCompressor(fd, compression));
+}
+
+bool OutputBuffer::flush()
+{
+    drain();
+    if (compressor)
+        failed = !compressor->finish() || failed;
+    return !failed;
+}
+
+void OutputBuffer::drain()
+{
+    if (compressor) {
+        if (used)
+            compressor->submit(buffer, used);
+        written += used;
+    } else {
+        writeAll(buffer.data(), used);
+    }
+    used = 0;
+}
+
+void OutputBuffer::writeAll(const char* data, size_t size)
+{
+    if (compressor) {
+        std::vector<char> block(data, data + size);
+        if (size)
+            compressor->submit(block, size);
+        written += size;
+        return;
+    }
+    while (size > 0 && !failed) {
+        ssize_t n = ::write(fd, data, size);
+        if (n < 0) {
+            failed = errno != EINTR;
+            continue;
+        }
+        data += n;
+        size -= n;
+        written += n;
+    }
+}
+
+IndexSpill::~IndexSpill()
+{
+    if (fd >= 0)
+        ::close(fd);
+}
+
+bool IndexSpill::open()
+{
+    const char* dir = std::getenv("TMPDIR");
+    std::string path = std::string(dir && *dir ? dir : "/tmp") + "/objtoarr-XXXXXX";
+    fd = mkstemp(&path[0]);
+    if (fd < 0)
+        return false;
+    unlink(path.c_str());
+    return true;
+}
+
+void IndexSpill::spill()
+{
+    size_t bytes = block.size() * sizeof(unsigned int);
+    failed = failed || ::write(fd, block.data(), bytes) != ssize_t(bytes);
+    spilled += block.size();
+    block.clear();
+}
+
+std::vector<std::string_view> splitLines(std::string_view text, unsigned int n)
+{
+    std::vector<std::string_view> chunks;
+    size_t begin = 0;
+    for (unsigned int i = 1; i <= n && begin < text.size(); ++i) {
+        size_t end = i == n ? text.size() : std::max(begin, text.size() / n * i);
+        end = end < text.size() ? text.find('\n', end) : text.size();
+        end = end == std::string_view::npos ? text.size() : end + 1;
+        chunks.push_back(text.substr(begin, end - begin));
+        begin = end;
+    }
+    return chunks;
+}
+
+double vertexCacheMissRatio(const std::vector<unsigned int>& indices, size_t vertexCount,
+                            unsigned int cacheSize)
+{
+    // A vertex is cached while fewer than cacheSize misses followed its own
+    std::vector<size_t> missedAt(vertexCount, 0);
+    size_t misses = 0;
+    for (unsigned int i : indices) {
+        if (!missedAt[i] || misses - missedAt[i] >= cacheSize)
+            missedAt[i] = ++misses;
+    }
+    return indices.size() >= 3 ? double(misses) / (indices.size() / 3) : 0.0;
+}
+
+void optimizeVertexCache(std::vector<unsigned int>& indices, size_t vertexCount,
+                         unsigned int cacheSize)
+{
+    size_t triangles = indices.size() / 3;
+    if (!triangles)
+        return;
+
+    // Triangles around every vertex, and how many of them are still to emit
+    std::vector<unsigned int> live(vertexCount, 0);
+    for (size_t i = 0; i < triangles * 3; ++i)
+        ++live[indices[i]];
+    std::vector<size_t> firstTriangle(vertexCount + 1, 0);
+    for (size_t v = 0; v < vertexCount; ++v)
+        firstTriangle[v + 1] = firstTriangle[v] + live[v];
+    std::vector<unsigned int> adjacency(firstTriangle[vertexCount]);
+    {
+        std::vector<size_t> next(firstTriangle.begin(), firstTriangle.end() - 1);
+        for (size_t i = 0; i < triangles * 3; ++i)
+            adjacency[next[indices[i]]++] = static_cast<unsigned int>(i / 3);
+    }
+
+    std::vector<unsigned int> output;
+    output.reserve(indices.size());
+    std::vector<size_t> cacheTime(vertexCount, 0);
+    std::vector<bool> emitted(triangles, false);
+    std::vector<unsigned int> deadEnd, candidates;
+    size_t time = cacheSize + 1;
+    size_t cursor = 0;
+    long fan = indices[0];
+
+    while (fan >= 0) {
+        // Emit every remaining triangle around the fanning vertex
+        candidates.clear();
+        for (size_t a = firstTriangle[fan]; a < firstTriangle[fan + 1]; ++a) {
+            unsigned int t = adjacency[a];
+            if (emitted[t])
+                continue;
+            emitted[t] = true;
+            for (int k = 0; k < 3; ++k) {
+                unsigned int v = indices[3 * t + k];
+                output.push_back(v);
+                deadEnd.push_back(v);
+                candidates.push_back(v);
+                --live[v];
+                if (time - cacheTime[v] > cacheSize)
+                    cacheTime[v] = time++;
+            }
+        }
+
+        // Continue with the candidate that stays in the cache and is used
+        // the most, falling back to a recent or any unfinished vertex
+        fan = -1;
+        long best = -1;
+        for (unsigned int v : candidates) {
+            if (!live[v])
+                continue;
+            long priority = 0;
+            if (time - cacheTime[v] + 2 * live[v] <= cacheSize)
+                priority = time - cacheTime[v];
+            if (priority > best) {
+                best = priority;
+                fan = v;
+            }
+        }
+        while (fan < 0 && !deadEnd.empty()) {
+            unsigned int v = deadEnd.back();
+            deadEnd.pop_back();
+            if (live[v])
+                fan = v;
+        }
+        for (; fan < 0 && cursor < vertexCount; ++cursor) {
+            if (live[cursor])
+                fan = cursor;
+        }
+    }
+    // Keep a trailing partial triangle, if any
+    output.insert(output.end(), indices.begin() + triangles * 3, indices.end());
+    indices.swap(output);
+}
+
+namespace {
+
+// Sum of weighted squared distances to a set of planes, the error metric of
+// Garland and Heckbert's simplification. Holds the upper triangle of the
+// symmetric 4 x 4 matrix: n n^T, d n and d^2 of the planes.
+struct Quadric {
+    double q[10] = {};
+
+    // Adds the plane n.p + d = 0 of unit normal n
+    void addPlane(const double n[3], double d, double weight)
+    {
+        const double terms[10] = {n[0] * n[0], n[0] * n[1], n[0] * n[2], n[1] * n[1], n[1] * n[2],
+                                  n[2] * n[2], d * n[0], d * n[1], d * n[2], d * d};
+        for (int k = 0; k < 10; ++k)
+            q[k] += weight * terms[k];
+    }
+    Quadric& operator+=(const Quadric& other)
+    {
+        for (int k = 0; k < 10; ++k)
+            q[k] += other.q[k];
+        return *this;
+    }
+    Quadric& operator-=(const Quadric& other)
+    {
+        for (int k = 0; k < 10; ++k)
+            q[k] -= other.q[k];
+        return *this;
+    }
+    // The weighted sum of squared distances of the point to the planes
+    double error(const double* p) const
+    {
+        double x = p[0], y = p[1], z = p[2];
+        double e = q[0] * x * x + q[3] * y * y + q[5] * z * z + 2 * (q[1] * x * y + q[2] * x * z + q[4] * y * z)
+            + 2 * (q[6] * x + q[7] * y + q[8] * z) + q[9];
+        return std::max(e, 0.0);
+    }
+};
+
+// Border edges weigh as much as a plane across them this many times their
+// length squared, so borders keep their shape
+const double BorderWeight = 10;
+
+// Triangles of the mesh small enough to parallelize over, or larger ones as
+// a whole, simplified in local numbers
+const size_t PartTriangles = 1 << 14;
+
+// A set of triangles simplified on its own, in numbers local to the set
+struct SimplifyPart {
+    std::vector<unsigned int> corners;     // 3 local vertices per triangle
+    std::vector<unsigned int> vertices;    // Vertex of every local vertex in the parent numbering
+    std::vector<unsigned int> vertexGroup; // Local position of every local vertex
+    std::vector<unsigned int> groups;      // Position of every local position in the parent numbering
+    std::vector<double> positions;         // x, y, z of every local position
+    std::vector<Quadric> quadrics;         // Error of moving every local position
+    std::vector<char> locked;              // Whether a local position has to stay
+
+    unsigned int group(size_t corner) const { return vertexGroup[corners[corner]]; }
+    const double* position(unsigned int g) const { return &positions[3 * size_t(g)]; }
+};
+
+// Numbers the triangle corners within the part in the order they come,
+// given the positions of the parent's vertices. A position the locked
+// function is true for stays put, and quadrics, when given, start off as the
+// parent's. The maps from parent to local numbers must be all unmapped for
+// every parent vertex and position, and are left that way.
+const unsigned int Unmapped = ~0u;
+template <typename F>
+SimplifyPart makePart(const unsigned int* corners, size_t count, const std::vector<unsigned int>& vertexGroup,
+                      const std::vector<double>& positions, const std::vector<Quadric>* quadrics, F locked,
+                      std::vector<unsigned int>& vertexMap, std::vector<unsigned int>& groupMap)
+{
+    SimplifyPart part;
+    part.corners.resize(count);
+    for (size_t i = 0; i < count; ++i) {
+        unsigned int& local = vertexMap[corners[i]];
+        if (local == Unmapped) {
+            local = static_cast<unsigned int>(part.vertices.size());
+            part.vertices.push_back(corners[i]);
+            unsigned int& group = groupMap[vertexGroup[corners[i]]];
+            if (group == Unmapped) {
+                group = static_cast<unsigned int>(part.groups.size());
+                part.groups.push_back(vertexGroup[corners[i]]);
+            }
+            part.vertexGroup.push_back(group);
+        }
+        part.corners[i] = local;
+    }
+    for (unsigned int v : part.vertices)
+        vertexMap[v] = Unmapped;
+    for (unsigned int g : part.groups)
+        groupMap[g] = Unmapped;
+
+    size_t G = part.groups.size();
+    part.positions.resize(3 * G);
+    part.quadrics.resize(G);
+    part.locked.resize(G);
+    for (size_t g = 0; g < G; ++g) {
+        unsigned int parent = part.groups[g];
+        std::copy(&positions[3 * size_t(parent)], &positions[3 * size_t(parent)] + 3, &part.positions[3 * g]);
+        if (quadrics)
+            part.quadrics[g] = (*quadrics)[parent];
+        part.locked[g] = locked(parent);
+    }
+    return part;
+}
+
+// Lists the triangles around every position of the part
+void partAdjacency(const SimplifyPart& part, std::vector<size_t>& first, std::vector<unsigned int>& around)
+{
+    size_t G = part.groups.size(), C = part.corners.size();
+    first.assign(G + 1, 0);
+    for (size_t i = 0; i < C; ++i)
+        ++first[part.group(i) + 1];
+    for (size_t g = 0; g < G; ++g)
+        first[g + 1] += first[g];
+    around.resize(C);
+    std::vector<size_t> next(first.begin(), first.end() - 1);
+    for (size_t i = 0; i < C; ++i)
+        around[next[part.group(i)]++] = static_cast<unsigned int>(i / 3);
+}
+
+// The corner of the triangle at the position, or -1
+inline int cornerAt(const SimplifyPart& part, unsigned int t, unsigned int g)
+{
+    for (int c = 0; c < 3; ++c) {
+        if (part.group(3 * size_t(t) + c) == g)
+            return c;
+    }
+    return -1;
+}
+
+inline void cross(const double u[3], const double v[3], double out[3])
+{
+    out[0] = u[1] * v[2] - u[2] * v[1];
+    out[1] = u[2] * v[0] - u[0] * v[2];
+    out[2] = u[0] * v[1] - u[1] * v[0];
+}
+
+// Cross product of the edges of the triangle from its first corner
+inline void triangleNormal(const double* p0, const double* p1, const double* p2, double out[3])
+{
+    const double u[3] = {p1[0] - p0[0], p1[1] - p0[1], p1[2] - p0[2]};
+    const double v[3] = {p2[0] - p0[0], p2[1] - p0[1], p2[2] - p0[2]};
+    cross(u, v, out);
+}
+
+// Sums the planes of the triangles around every position, weighted by their
+// area, and of their border edges
+void computeQuadrics(SimplifyPart& part, unsigned int threads)
+{
+    std::vector<size_t> first;
+    std::vector<unsigned int> around;
+    partAdjacency(part, first, around);
+    size_t G = part.groups.size();
+    runParallel(threads, [&](unsigned int t) {
+        auto range = splitRange(G, t, threads);
+        std::vector<unsigned int> neighbours;
+        for (size_t g = range.first; g < range.second; ++g) {
+            // Every neighbour is on two triangles around the position, or
+            // on one across a border edge
+            neighbours.clear();
+            for (size_t a = first[g]; a < first[g + 1]; ++a) {
+                for (int c = 0; c < 3; ++c) {
+                    unsigned int h = part.group(3 * size_t(around[a]) + c);
+                    if (h != g)
+                        neighbours.push_back(h);
+                }
+            }
+            std::sort(neighbours.begin(), neighbours.end());
+            Quadric q;
+            for (size_t a = first[g]; a < first[g + 1]; ++a) {
+                const size_t base = 3 * size_t(around[a]);
+                const double* p[3] = {part.position(part.group(base)), part.position(part.group(base + 1)),
+                                      part.position(part.group(base + 2))};
+                double n[3];
+                triangleNormal(p[0], p[1], p[2], n);
+                double length = std::sqrt(n[0] * n[0] + n[1] * n[1] + n[2] * n[2]);
+                if (!(length > 0 && length < std::numeric_limits<double>::infinity()))
+                    continue;
+                for (double& value : n)
+                    value /= length;
+                q.addPlane(n, -(n[0] * p[0][0] + n[1] * p[0][1] + n[2] * p[0][2]), length / 2);
+
+                for (int c = 0; c < 3; ++c) {
+                    unsigned int h = part.group(base + c);
+                    auto uses = std::equal_range(neighbours.begin(), neighbours.end(), h);
+                    if (h == g || uses.second - uses.first != 1)
+                        continue;
+                    const double* from = part.position(g);
+                    const double* to = part.position(h);
+                    const double edge[3] = {to[0] - from[0], to[1] - from[1], to[2] - from[2]};
+                    double m[3];
+                    cross(edge, n, m);
+                    double mLength = std::sqrt(m[0] * m[0] + m[1] * m[1] + m[2] * m[2]);
+                    if (!(mLength > 0))
+                        continue;
+                    for (double& value : m)
+                        value /= mLength;
+                    double edgeLength2 = edge[0] * edge[0] + edge[1] * edge[1] + edge[2] * edge[2];
+                    q.addPlane(m, -(m[0] * from[0] + m[1] * from[1] + m[2] * from[2]), BorderWeight * edgeLength2);
+                }
+            }
+            part.quadrics[g] = q;
+        }
+    });
+}
+
+enum GroupKind {
+    GroupInterior, // Surrounded by triangles
+    GroupBorder,   // On one open border
+    GroupLocked,   // Locked, non-manifold or where borders meet
+};
+
+// Collapses edges of the part onto one of their ends until at most target
+// triangles are left or no edge can collapse. Every pass sorts the half-edge
+// collapses by the quadric error of the position moved onto the one kept,
+// and performs them in order while they touch none of the positions the
+// pass has changed so far, so every check sees the mesh as it is.
+void collapseEdges(SimplifyPart& part, size_t target)
+{
+    size_t G = part.groups.size();
+    std::vector<size_t> first;
+    std::vector<unsigned int> around;
+    std::vector<unsigned char> kind(G);
+    std::vector<unsigned int> touched(G, 0);
+    std::vector<unsigned int> remap(part.vertices.size());
+    for (size_t v = 0; v < remap.size(); ++v)
+        remap[v] = static_cast<unsigned int>(v);
+    std::vector<uint32_t> keys;
+    std::vector<unsigned int> candidates, neighbours, others;
+    std::vector<std::pair<unsigned int, unsigned int>> pairs;
+
+    // Sorted positions of the triangles around g, other than g and skip
+    auto neighbourList = [&](unsigned int g, unsigned int skip, std::vector<unsigned int>& out) {
+        out.clear();
+        for (size_t a = first[g]; a < first[g + 1]; ++a) {
+            for (int c = 0; c < 3; ++c) {
+                unsigned int h = part.group(3 * size_t(around[a]) + c);
+                if (h != g && h != skip)
+                    out.push_back(h);
+            }
+        }
+        std::sort(out.begin(), out.end());
+    };
+
+    // Checks collapsing position a onto b, and remaps the vertices of a if
+    // it can. Returns the number of triangles removed, or 0.
+    auto collapse = [&](unsigned int a, unsigned int b) -> size_t {
+        // The triangles on the edge pair every vertex of a with the one of b
+        // it continues as. A vertex of a with no or two partners is on an
+        // attribute seam that the collapse would tear.
+        pairs.clear();
+        size_t shared = 0;
+        for (size_t i = first[a]; i < first[a + 1]; ++i) {
+            unsigned int t = around[i];
+            int ca = cornerAt(part, t, a), cb = cornerAt(part, t, b);
+            if (cb < 0)
+                continue;
+            ++shared;
+            unsigned int va = part.corners[3 * size_t(t) + ca], vb = part.corners[3 * size_t(t) + cb];
+            auto known = std::find_if(pairs.begin(), pairs.end(), [va](const auto& p) { return p.first == va; });
+            if (known == pairs.end())
+                pairs.push_back({va, vb});
+            else if (known->second != vb)
+                return 0;
+        }
+        // Borders only collapse along themselves
+        if (!shared || shared > 2 || (kind[a] == GroupBorder) != (shared == 1))
+            return 0;
+        for (size_t i = first[a]; i < first[a + 1]; ++i) {
+            unsigned int va = part.corners[3 * size_t(around[i]) + cornerAt(part, around[i], a)];
+            if (std::none_of(pairs.begin(), pairs.end(), [va](const auto& p) { return p.first == va; }))
+                return 0;
+        }
+
+        // The ends may only share the neighbours across the edge, or the
+        // collapse would pinch the surface
+        neighbourList(a, b, neighbours);
+        neighbours.erase(std::unique(neighbours.begin(), neighbours.end()), neighbours.end());
+        neighbourList(b, a, others);
+        others.erase(std::unique(others.begin(), others.end()), others.end());
+        size_t common = 0;
+        for (size_t i = 0, j = 0; i < neighbours.size() && j < others.size();) {
+            if (neighbours[i] == others[j]) {
+                ++common;
+                ++i;
+                ++j;
+            } else if (neighbours[i] < others[j]) {
+                ++i;
+            } else {
+                ++j;
+            }
+        }
+        if (common != shared)
+            return 0;
+        // Edges between locked positions may also be on triangles of other
+        // parts, so a locked b may only gain edges to unlocked positions
+        if (part.locked[b]) {
+            for (unsigned int x : neighbours) {
+                if (part.locked[x] && !std::binary_search(others.begin(), others.end(), x))
+                    return 0;
+            }
+        }
+
+        // No remaining triangle may flip, or turn by more than about 75
+        // degrees
+        for (size_t i = first[a]; i < first[a + 1]; ++i) {
+            const size_t base = 3 * size_t(around[i]);
+            const double* p[3];
+            int moved = -1;
+            for (int c = 0; c < 3; ++c) {
+                unsigned int g = part.group(base + c);
+                if (g == b)
+                    moved = -2;
+                if (g == a && moved == -1)
+                    moved = c;
+                p[c] = part.position(g);
+            }
+            if (moved < 0)
+                continue;
+            double before[3], after[3];
+            triangleNormal(p[0], p[1], p[2], before);
+            p[moved] = part.position(b);
+            triangleNormal(p[0], p[1], p[2], after);
+            double dot = before[0] * after[0] + before[1] * after[1] + before[2] * after[2];
+            double lengths = std::sqrt((before[0] * before[0] + before[1] * before[1] + before[2] * before[2])
+                                       * (after[0] * after[0] + after[1] * after[1] + after[2] * after[2]));
+            if (!(dot > 0.25 * lengths))
+                return 0;
+        }
+
+        for (const auto& p : pairs)
+            remap[p.first] = p.second;
+        return shared;
+    };
+
+    for (unsigned int pass = 1;; ++pass) {
+        size_t T = part.corners.size() / 3;
+        if (T <= target)
+            break;
+        partAdjacency(part, first, around);
+        // Only the positions the last pass changed can change their kind
+        for (unsigned int g = 0; g < G; ++g) {
+            if (pass > 1 && touched[g] != pass - 1)
+                continue;
+            if (part.locked[g]) {
+                kind[g] = GroupLocked;
+                continue;
+            }
+            // Every neighbour is on one triangle across a border edge and
+            // on two across an interior one
+            neighbourList(g, g, neighbours);
+            size_t borders = 0;
+            bool manifold = true;
+            for (size_t i = 0, j; i < neighbours.size(); i = j) {
+                for (j = i + 1; j < neighbours.size() && neighbours[j] == neighbours[i]; ++j) {}
+                borders += j - i == 1;
+                manifold = manifold && j - i <= 2;
+            }
+            kind[g] = !manifold || (borders && borders != 2) ? GroupLocked : borders ? GroupBorder : GroupInterior;
+        }
+
+        // Every half-edge collapses its start onto its end, and the reverse
+        // comes from the opposite half-edge, which borders lack. Errors that
+        // are NaN are left out.
+        keys.clear();
+        candidates.clear();
+        for (size_t h = 0; h < 3 * T; ++h) {
+            unsigned int ends[2] = {part.group(h), part.group(h - h % 3 + (h % 3 + 1) % 3)};
+            for (int d = 0; d < 2; ++d) {
+                if (kind[ends[d]] == GroupLocked || (d && kind[ends[d]] != GroupBorder))
+                    continue;
+                double error = part.quadrics[ends[d]].error(part.position(ends[1 - d]));
+                if (std::isnan(error))
+                    continue;
+                keys.push_back(sortableKey(float(error)));
+                candidates.push_back(static_cast<unsigned int>(2 * h + d));
+            }
+        }
+        if (candidates.empty())
+            break;
+        radixSort(keys, candidates, 1);
+
+        // Only collapses about as cheap as the ones the pass needs, with room
+        // for those that fail and at least a slice of all of them. If they
+        // all fail, any other may go.
+        size_t needed = T - target, removed = 0, collapses = 0;
+        uint32_t limit = keys[std::min(keys.size() - 1, std::max(4 * needed, keys.size() / 16))];
+        for (size_t i = 0; i < candidates.size() && removed < needed; ++i) {
+            if (keys[i] > limit) {
+                if (collapses)
+                    break;
+                limit = ~0u;
+            }
+            size_t h = candidates[i] >> 1;
+            unsigned int a = part.group(h), b = part.group(h - h % 3 + (h % 3 + 1) % 3);
+            if (candidates[i] & 1)
+                std::swap(a, b);
+            if (touched[a] == pass || touched[b] == pass)
+                continue;
+            size_t shared = collapse(a, b);
+            if (!shared)
+                continue;
+            touched[a] = touched[b] = pass;
+            for (size_t k = first[a]; k < first[a + 1]; ++k) {
+                for (int c = 0; c < 3; ++c)
+                    touched[part.group(3 * size_t(around[k]) + c)] = pass;
+            }
+            part.quadrics[b] += part.quadrics[a];
+            removed += shared;
+            ++collapses;
+        }
+        if (!collapses)
+            break;
+
+        // Drop the triangles on the collapsed edges
+        size_t kept = 0;
+        for (size_t t = 0; t < T; ++t) {
+            unsigned int v[3];
+            for (int c = 0; c < 3; ++c)
+                v[c] = remap[part.corners[3 * t + c]];
+            unsigned int g0 = part.vertexGroup[v[0]], g1 = part.vertexGroup[v[1]], g2 = part.vertexGroup[v[2]];
+            if (g0 == g1 || g1 == g2 || g0 == g2)
+                continue;
+            std::copy(v, v + 3, &part.corners[3 * kept++]);
+        }
+        part.corners.resize(3 * kept);
+    }
+}
+
+} // namespace
+
+std::vector<unsigned int> simplifyTriangles(const SimplifyMesh& mesh, const std::vector<unsigned int>& indices,
+                                            size_t targetTriangles, unsigned int threads)
+{
+    // Triangles without area at any scale only get in the way
+    std::vector<unsigned int> corners;
+    corners.reserve(indices.size() - indices.size() % 3);
+    for (size_t i = 0; i + 2 < indices.size(); i += 3) {
+        unsigned int g0 = mesh.vertexPosition[indices[i]], g1 = mesh.vertexPosition[indices[i + 1]],
+                     g2 = mesh.vertexPosition[indices[i + 2]];
+        if (g0 != g1 && g1 != g2 && g0 != g2)
+            corners.insert(corners.end(), &indices[i], &indices[i] + 3);
+    }
+    size_t T = corners.size() / 3;
+    if (T <= targetTriangles)
+        return corners;
+
+    std::vector<unsigned int> vertexMap(mesh.vertexPosition.size(), Unmapped);
+    std::vector<unsigned int> groupMap(mesh.positions.size() / 3, Unmapped);
+    SimplifyPart whole = makePart(corners.data(), corners.size(), mesh.vertexPosition, mesh.positions, 0,
+                                  [](unsigned int) { return false; }, vertexMap, groupMap);
+    std::vector<unsigned int>().swap(corners);
+    computeQuadrics(whole, threads);
+
+    if (T >= 2 * PartTriangles) {
+        // Split the triangles into runs along a Morton curve of their
+        // centroids, which depend on the mesh alone
+        double low[3], high[3];
+        for (int axis = 0; axis < 3; ++axis) {
+            low[axis] = std::numeric_limits<double>::infinity();
+            high[axis] = -low[axis];
+        }
+        for (size_t g = 0; g < whole.groups.size(); ++g) {
+            for (int axis = 0; axis < 3; ++axis) {
+                low[axis] = std::min(low[axis], whole.position(g)[axis]);
+                high[axis] = std::max(high[axis], whole.position(g)[axis]);
+            }
+        }
+        double extent = std::max({high[0] - low[0], high[1] - low[1], high[2] - low[2]});
+        double scale = extent > 0 && extent < std::numeric_limits<double>::infinity() ? 0x1FFFFF / extent : 0;
+        std::vector<uint64_t> keys(T);
+        std::vector<unsigned int> order(T);
+        runParallel(threads, [&](unsigned int t) {
+            auto range = splitRange(T, t, threads);
+            for (size_t i = range.first; i < range.second; ++i) {
+                uint64_t key = 0;
+                for (int axis = 0; axis < 3; ++axis) {
+                    double centroid = (whole.position(whole.group(3 * i))[axis]
+                                       + whole.position(whole.group(3 * i + 1))[axis]
+                                       + whole.position(whole.group(3 * i + 2))[axis]) / 3;
+                    double cell = (centroid - low[axis]) * scale;
+                    key |= spreadBits(uint64_t(cell >= 0 ? std::min(cell, double(0x1FFFFF)) : 0)) << axis;
+                }
+                keys[i] = key;
+                order[i] = static_cast<unsigned int>(i);
+            }
+        });
+        radixSort(keys, order, threads);
+        std::vector<uint64_t>().swap(keys);
+
+        // Positions on triangles of two parts are shared and stay put
+        const unsigned int unowned = ~0u, shared = ~0u - 1;
+        size_t P = (T + PartTriangles - 1) / PartTriangles;
+        std::vector<unsigned int> owner(whole.groups.size(), unowned);
+        std::vector<std::vector<unsigned int>> partCorners(P);
+        for (size_t k = 0; k < T; ++k) {
+            unsigned int p = static_cast<unsigned int>(k / PartTriangles);
+            for (int c = 0; c < 3; ++c) {
+                unsigned int v = whole.corners[3 * size_t(order[k]) + c];
+                unsigned int& g = owner[whole.vertexGroup[v]];
+                g = g == unowned || g == p ? p : shared;
+                partCorners[p].push_back(v);
+            }
+        }
+        std::vector<unsigned int>().swap(order);
+
+        // Simplify the parts to their share of the target. Every part writes
+        // the quadrics of the positions it owns and keeps the changes to
+        // the shared ones, which are added up in order afterwards.
+        std::vector<std::vector<std::pair<unsigned int, Quadric>>> sharedChanges(P);
+        std::atomic<size_t> nextPart(0);
+        runParallel(std::min<size_t>(threads, P), [&](unsigned int) {
+            std::vector<unsigned int> partVertexMap(whole.vertices.size(), Unmapped);
+            std::vector<unsigned int> partGroupMap(whole.groups.size(), Unmapped);
+            for (size_t p; (p = nextPart.fetch_add(1)) < P;) {
+                std::vector<unsigned int>& corners = partCorners[p];
+                SimplifyPart part = makePart(corners.data(), corners.size(), whole.vertexGroup, whole.positions,
+                                             &whole.quadrics, [&](unsigned int g) { return owner[g] != p; },
+                                             partVertexMap, partGroupMap);
+                size_t triangles = corners.size() / 3;
+                collapseEdges(part, static_cast<size_t>(double(triangles) * targetTriangles / T + 0.5));
+                corners.resize(part.corners.size());
+                for (size_t i = 0; i < corners.size(); ++i)
+                    corners[i] = part.vertices[part.corners[i]];
+                for (size_t g = 0; g < part.groups.size(); ++g) {
+                    unsigned int parent = part.groups[g];
+                    if (owner[parent] == p) {
+                        whole.quadrics[parent] = part.quadrics[g];
+                    } else {
+                        part.quadrics[g] -= whole.quadrics[parent];
+                        sharedChanges[p].push_back({parent, part.quadrics[g]});
+                    }
+                }
+            }
+        });
+        whole.corners.clear();
+        for (size_t p = 0; p < P; ++p) {
+            whole.corners.insert(whole.corners.end(), partCorners[p].begin(), partCorners[p].end());
+            std::vector<unsigned int>().swap(partCorners[p]);
+            for (const auto& change : sharedChanges[p])
+                whole.quadrics[change.first] += change.second;
+        }
+    }
+
+    // Finish along the borders of the parts
+    collapseEdges(whole, targetTriangles);
+    std::vector<unsigned int> result(whole.corners.size());
+    for (size_t i = 0; i < result.size(); ++i)
+        result[i] = whole.vertices[whole.corners[i]];
+    return result;
+}
+
+void writeIndices(OutputBuffer& out, const unsigned int* indices, size_t count, size_t first,
+                  std::string_view indent, unsigned int threads)
+{
+    // Blocks of whole triangles
+    writeParallel(out, count, 3 << 15, threads, [&](OutputBuffer& buffer, size_t begin, size_t end) {
+        for (size_t i = first + begin, N = first + end; i < N; ++i) {
+            if (i % 3 == 0)
+                buffer.write(indent);
+            buffer.writeNumber(indices[i - first]);
+            buffer.put(',');
+            buffer.put(i % 3 == 2 ? '\n' : ' ');
+        }
+    });
+}
+
+void writeMeshlets(OutputBuffer& out, const std::vector<Meshlet>& meshlets, std::string_view indent,
+                   int precision)
+{
+    out.write(indent);
+    out.write("// Meshlets: vertex offset, vertex count, index offset, index count, "
+              "center x, y, z, radius, min x, y, z, max x, y, z\n");
+    for (const Meshlet& m : meshlets) {
+        out.write(indent);
+        out.writeNumber(m.vertexOffset); out.write(", ");
+        out.writeNumber(m.vertexCount); out.write(", ");
+        out.writeNumber(m.indexOffset); out.write(", ");
+        out.writeNumber(m.indexCount);
+        const float* bounds[] = {m.center, &m.radius, m.min, m.max};
+        const int sizes[] = {3, 1, 3, 3};
+        for (int b = 0; b < 4; ++b) {
+            for (int i = 0; i < sizes[b]; ++i) {
+                out.write(", ");
+                out.writeNumber(bounds[b][i], precision);
+            }
+        }
+        out.write(",\n");
+    }
+    out.put('\n');
+}
+
+void writeLods(OutputBuffer& out, const std::vector<std::vector<unsigned int>>& lods, std::string_view indent,
+               unsigned int threads)
+{
+    for (size_t level = 0; level < lods.size(); ++level) {
+        out.write(indent); out.write("// Element Index Array LOD ");
+        out.writeNumber(static_cast<unsigned int>(level + 1));
+        out.put('\n');
+        writeIndices(out, lods[level].data(), lods[level].size(), 0, indent, threads);
+        out.put('\n');
+    }
+}
+
+void writeBinaryBounds(OutputBuffer& out, const Bounds& bounds)
+{
+    while (out.bytesWritten() % 4)
+        out.put('\0');
+    out.write("BNDS");
+    for (double value : bounds.min)
+        writeLittleEndian(out, float(value));
+    for (double value : bounds.max)
+        writeLittleEndian(out, float(value));
+}
+
+void writeBinaryMeshlets(OutputBuffer& out, const std::vector<Meshlet>& meshlets)
+{
+    while (out.bytesWritten() % 4)
+        out.put('\0');
+    out.write("MSHL");
+    writeLittleEndian(out, static_cast<uint32_t>(meshlets.size()));
+    for (const Meshlet& m : meshlets) {
+        writeLittleEndian(out, m.vertexOffset);
+        writeLittleEndian(out, m.vertexCount);
+        writeLittleEndian(out, m.indexOffset);
+        writeLittleEndian(out, m.indexCount);
+        for (float value : m.center)
+            writeLittleEndian(out, value);
+        writeLittleEndian(out, m.radius);
+        for (float value : m.min)
+            writeLittleEndian(out, value);
+        for (float value : m.max)
+            writeLittleEndian(out, value);
+    }
+}
+
+namespace {
+
+const uint64_t Prime1 = 0x9E3779B185EBCA87ull, Prime2 = 0xC2B2AE3D27D4EB4Full, Prime3 = 0x165667B19E3779F9ull,
+               Prime4 = 0x85EBCA77C2B2AE63ull, Prime5 = 0x27D4EB2F165667C5ull;
+
+inline uint64_t rotateLeft(uint64_t x, int bits) { return x << bits | x >> (64 - bits); }
+
+inline uint64_t hashRound(uint64_t acc, uint64_t input)
+{
+    return rotateLeft(acc + input * Prime2, 31) * Prime1;
+}
+
+template <typename T>
+inline T readUnaligned(const unsigned char* p)
+{
+    T value;
+    std::memcpy(&value, p, sizeof(value));
+    return value;
+}
+
+} // namespace
+
+uint64_t hashBytes(const void* data, size_t size, uint64_t seed)
+{
+    const unsigned char* p = static_cast<const unsigned char*>(data);
+    const unsigned char* end = p + size;
+    uint64_t h;
+    if (size >= 32) {
+        // Four lanes over 32 byte stripes
+        uint64_t lanes[4] = {seed + Prime1 + Prime2, seed + Prime2, seed, seed - Prime1};
+        for (; end - p >= 32; p += 32) {
+            for (int k = 0; k < 4; ++k)
+                lanes[k] = hashRound(lanes[k], readUnaligned<uint64_t>(p + 8 * k));
+        }
+        h = rotateLeft(lanes[0], 1) + rotateLeft(lanes[1], 7) + rotateLeft(lanes[2], 12)
+          + rotateLeft(lanes[3], 18);
+        for (uint64_t lane : lanes)
+            h = (h ^ hashRound(0, lane)) * Prime1 + Prime4;
+    } else {
+        h = seed + Prime5;
+    }
+    h += size;
+    for (; end - p >= 8; p += 8)
+        h = rotateLeft(h ^ hashRound(0, readUnaligned<uint64_t>(p)), 27) * Prime1 + Prime4;
+    if (end - p >= 4) {
+        h = rotateLeft(h ^ readUnaligned<uint32_t>(p) * Prime1, 23) * Prime2 + Prime3;
+        p += 4;
+    }
+    for (; p < end; ++p)
+        h = rotateLeft(h ^ *p * Prime5, 11) * Prime1;
+    h ^= h >> 33;
+    h *= Prime2;
+    h ^= h >> 29;
+    h *= Prime3;
+    return h ^ (h >> 32);
+}
+
+void parseArguments(std::unordered_map<std::string, Argument>& parsedArgs,
+                    int numArgs, char** args, int offset)
+{
+    for (int i = offset; i < numArgs; ++i) {
+        std::string arg(args[i]);
+        // Skip non-arguments
+        if (arg[0] != '-' || arg[1] != '-')
+            continue;
+        // Try parsing the digit
+        Argument value = {1, std::string()};
+        size_t eqIndex = arg.find_last_of('=');
+        if (eqIndex != std::string::npos) {
+            value.text = arg.substr(eqIndex + 1);
+            value.value = std::atoi(value.text.c_str());
+        }
+        // Add the argument to the dictionary
+        parsedArgs[arg.substr(0, eqIndex)] = value;
+    }
+}
+
+template bool objToJs<float>(std::string_view, VertexBuffer<float>&, std::vector<unsigned int>&,
+                             bool, bool, unsigned int, ParseStats*, ParseContext<float>*);
+template void sortZX<float>(VertexBuffer<float>&, std::vector<unsigned int>&, unsigned int);
+template size_t weldVertices<float>(VertexBuffer<float>&, std::vector<unsigned int>&, double, unsigned int);
+template void transformVertices<float>(VertexBuffer<float>&, std::vector<unsigned int>&, const Transform&,
+                                       unsigned int);
+template size_t generateNormals<float>(VertexBuffer<float>&, std::vector<unsigned int>&, double, unsigned int);
+template void normalizeNormals<float>(VertexBuffer<float>&, unsigned int);
+template Bounds computeBounds<float>(const VertexBuffer<float>&, unsigned int);
+template void optimizeVertexFetch<float>(VertexBuffer<float>&, std::vector<unsigned int>&);
+template std::vector<Meshlet> buildMeshlets<float>(VertexBuffer<float>&, std::vector<unsigned int>&,
+                                                   unsigned int, unsigned int, unsigned int);
+template std::vector<std::vector<unsigned int>> buildLods<float>(const VertexBuffer<float>&,
+                                                                 const std::vector<unsigned int>&,
+                                                                 const std::vector<double>&, unsigned int);
+template void writeArrays<float>(OutputBuffer&, const VertexBuffer<float>&, const std::vector<unsigned int>&,
+                                 std::string_view, int, unsigned int);
+template void writeBinary<float>(OutputBuffer&, const VertexBuffer<float>&, const std::vector<unsigned int>&,
+                                 const Quantization*, bool);
+template bool objToJs<double>(std::string_view, VertexBuffer<double>&, std::vector<unsigned int>&,
+                              bool, bool, unsigned int, ParseStats*, ParseContext<double>*);
+template void sortZX<double>(VertexBuffer<double>&, std::vector<unsigned int>&, unsigned int);
+template size_t weldVertices<double>(VertexBuffer<double>&, std::vector<unsigned int>&, double, unsigned int);
+template void transformVertices<double>(VertexBuffer<double>&, std::vector<unsigned int>&, const Transform&,
+                                       unsigned int);
+template size_t generateNormals<double>(VertexBuffer<double>&, std::vector<unsigned int>&, double, unsigned int);
+template void normalizeNormals<double>(VertexBuffer<double>&, unsigned int);
+template Bounds computeBounds<double>(const VertexBuffer<double>&, unsigned int);
+template void optimizeVertexFetch<double>(VertexBuffer<double>&, std::vector<unsigned int>&);
+template std::vector<Meshlet> buildMeshlets<double>(VertexBuffer<double>&, std::vector<unsigned int>&,
+                                                    unsigned int, unsigned int, unsigned int);
+template std::vector<std::vector<unsigned int>> buildLods<double>(const VertexBuffer<double>&,
+                                                                  const std::vector<unsigned int>&,
+                                                                  const std::vector<double>&, unsigned int);
+template void writeArrays<double>(OutputBuffer&, const VertexBuffer<double>&, const std::vector<unsigned int>&,
+                                  std::string_view, int, unsigned int);
+template void writeBinary<double>(OutputBuffer&, const VertexBuffer<double>&, const std::vector<unsigned int>&,
+                                  const Quantization*, bool);
@@ -1,316 +1,1339 @@
+#include "obj-to-js-array.h"
+
 #include <iostream>
-#include <fstream>
 #include <string>
-#include <sstream>
+#include <string_view>
 #include <vector>
-#include <utility>
 #include <unordered_map>
 #include <algorithm>
+#include <limits>
+#include <thread>
+#include <chrono>
+#include <sstream>
+#include <deque>
+#include <mutex>
+#include <condition_variable>
+
+#include <csignal>
+#include <cstdio>
+
+#include <fcntl.h>
+#include <glob.h>
+#include <linux/fs.h>
+#include <sys/ioctl.h>
+#include <sys/resource.h>
+#include <sys/sendfile.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+// Conversion settings from the command line
+struct Options {
+    bool disableTexture = false;
+    bool disableNormal = false;
+    int tabLevel = 0;
+    bool useTabs = false;
+    int precision = 5;
+    bool sortZX = false;
+    bool weld = false;
+    double weldEpsilon = 0; // Largest difference of merged attributes
+    unsigned int threads = 1;
+    std::string format = "text";
+    bool stream = false;
+    unsigned int cacheSize = 0; // Vertex cache to optimize for, or 0
+    bool quantize = false;
+    TexcoordEncoding texcoordEncoding = TexcoordHalf;
+    bool encodeIndices = false; // Delta and varint coded binary indices
+    bool meshlets = false;
+    unsigned int meshletVertices = 64, meshletTriangles = 124; // Limits per meshlet
+    std::vector<double> lods; // Triangle ratios of the levels of detail
+    std::string cacheDir; // Directory of the conversion cache, or empty
+    Compression compression = CompressionNone;
+    std::string statePath; // Parser state file of --incremental, or empty
+    bool transform = false;
+    Transform matrix;       // Applied to the positions with --transform
+    bool center = false;
+    bool normalizeNormals = false;
+    bool generateNormals = false;
+    double creaseAngle = 180; // Largest angle in degrees between smoothed triangles
+};
+
+// Whether the vertices go through the transform pass, which also writes the
+// bounds to the output
+inline bool transformsVertices(const Options& options)
+{
+    return options.transform || options.center || options.normalizeNormals;
+}
+
+// Parses --transform: either a uniform scale, or 12 or 16 comma separated
+// numbers of a row-major 3 x 4 or 4 x 4 affine matrix. Returns false if the
+// text is neither.
+bool parseTransform(const std::string& text, Transform& transform)
+{
+    std::vector<double> values;
+    const char* p = text.c_str();
+    for (;;) {
+        char* end;
+        values.push_back(std::strtod(p, &end));
+        if (end == p || (*end && *end != ','))
+            return false;
+        if (!*end)
+            break;
+        p = end + 1;
+    }
+    transform = Transform();
+    if (values.size() == 1) {
+        for (int axis = 0; axis < 3; ++axis)
+            transform.m[axis][axis] = values[0];
+        return true;
+    }
+    // The last row of a 4 x 4 matrix must leave w alone
+    if (values.size() == 16 && !(values[12] == 0 && values[13] == 0 && values[14] == 0 && values[15] == 1))
+        return false;
+    if (values.size() != 12 && values.size() != 16)
+        return false;
+    for (int r = 0; r < 3; ++r)
+        for (int c = 0; c < 4; ++c)
+            transform.m[r][c] = values[4*r + c];
+    return true;
+}
+
+// Gets the compression named on the command line, or that a file name
+// suffix implies when the name is a path. Returns false for unknown names.
+bool parseCompression(const std::string& name, bool isPath, Compression& compression)
+{
+    auto endsWith = [&name](std::string_view suffix) {
+        return name.size() >= suffix.size() && name.compare(name.size() - suffix.size(), suffix.size(), suffix) == 0;
+    };
+    if (isPath) {
+        compression = endsWith(".gz") ? CompressionGzip : endsWith(".zst") ? CompressionZstd : CompressionNone;
+        return true;
+    }
+    compression = name == "gzip" ? CompressionGzip : name == "zstd" ? CompressionZstd : CompressionNone;
+    return compression != CompressionNone || name == "none";
+}
+
+// The file name suffix of the compression
+const char* compressionSuffix(Compression compression)
+{
+    return compression == CompressionGzip ? ".gz" : compression == CompressionZstd ? ".zst" : "";
+}
+
+// Measurements of one conversion for --stats
+struct RunStats {
+    // Wall time per stage in seconds
+    double read = 0, parse = 0, normals = 0, weld = 0, transform = 0, sort = 0, optimize = 0, simplify = 0,
+           partition = 0, emit = 0;
+    size_t bytesRead = 0, bytesWritten = 0;
+    size_t vertices = 0, indices = 0;
+    size_t split = 0;  // Vertices added along creases by --gen-normals
+    size_t welded = 0; // Vertices merged by --weld
+    size_t meshlets = 0;
+    std::vector<size_t> lodTriangles; // Triangles of every level of detail
+    double acmrBefore = 0, acmrAfter = 0; // Average cache miss ratios with --optimize-cache
+    bool cached = false;                  // Whether the output came from the cache
+    ParseStats parsing;
+};
+
+// Measures the wall time since construction or the last lap
+class StageTimer {
+public:
+    StageTimer() : start(std::chrono::steady_clock::now()) {}
+    double lap()
+    {
+        auto now = std::chrono::steady_clock::now();
+        double seconds = std::chrono::duration<double>(now - start).count();
+        start = now;
+        return seconds;
+    }
+private:
+    std::chrono::steady_clock::time_point start;
+};
 
-// Helper types for internal data representation
-struct Vec3 { double x, y, z; };
-struct Vec2 { double x, y; };
-struct Vertex {
-    bool hasNorm, hasUV;
-    Vec3 p;
-    Vec3 n;
-    Vec2 t;
+// Buffers reused across consecutive conversions on one thread
+template <typename Real>
+struct Workspace {
+    ParseContext<Real> context;
+    VertexBuffer<Real> vbo;
+    std::vector<unsigned int> ebo;
 };
 
-// Write the vertex to the given stream
-std::ostream& operator<<(std::ostream& out, const Vertex& v)
+// Gets the peak resident memory of the process in KiB
+long peakMemory()
+{
+    struct rusage usage;
+    return getrusage(RUSAGE_SELF, &usage) == 0 ? usage.ru_maxrss : 0;
+}
+
+// Prints the peak resident memory of the process
+void reportPeakMemory()
+{
+    std::cerr << "Peak resident memory: " << peakMemory() << " KiB" << std::endl;
+}
+
+// Prints the measurements as one line of JSON
+void reportStats(const RunStats& stats)
+{
+    static const char* recordNames[] = {"blank", "v", "vt", "vn", "f", "other"};
+    const ParseStats& parsing = stats.parsing;
+    size_t misses = stats.vertices, hits = stats.indices - std::min(stats.indices, misses);
+
+    std::ostringstream out;
+    out << "{\"stages\": {\"read\": " << stats.read << ", \"parse\": " << stats.parse
+        << ", \"normals\": " << stats.normals
+        << ", \"weld\": " << stats.weld << ", \"transform\": " << stats.transform
+        << ", \"sort\": " << stats.sort << ", \"optimize\": " << stats.optimize
+        << ", \"simplify\": " << stats.simplify
+        << ", \"partition\": " << stats.partition << ", \"emit\": " << stats.emit
+        << ", \"total\": " << stats.read + stats.parse + stats.normals + stats.weld + stats.transform + stats.sort
+                                + stats.optimize + stats.simplify + stats.partition + stats.emit << "}"
+        << ", \"bytesRead\": " << stats.bytesRead << ", \"bytesWritten\": " << stats.bytesWritten
+        << ", \"records\": {";
+    for (int k = 0; k <= RecordOther; ++k)
+        out << (k ? ", \"" : "\"") << recordNames[k] << "\": " << parsing.records[k];
+    out << "}, \"vertices\": " << stats.vertices << ", \"indices\": " << stats.indices
+        << ", \"split\": " << stats.split << ", \"welded\": " << stats.welded
+        << ", \"meshlets\": " << stats.meshlets << ", \"lodTriangles\": [";
+    for (size_t i = 0; i < stats.lodTriangles.size(); ++i)
+        out << (i ? ", " : "") << stats.lodTriangles[i];
+    out << "]"
+        << ", \"dedup\": {\"hits\": " << hits << ", \"misses\": " << misses
+        << ", \"hitRatio\": " << (stats.indices ? double(hits) / stats.indices : 0.0)
+        << ", \"loadFactor\": "
+        << (parsing.tableSlots ? double(parsing.tableEntries) / parsing.tableSlots : 0.0) << "}"
+        << ", \"cached\": " << (stats.cached ? "true" : "false")
+        << ", \"peakRssKiB\": " << peakMemory() << "}";
+    std::cerr << out.str() << std::endl;
+}
+
+// Applies --transform, then --center and --normalize-normals to the vertices.
+// Returns the bounds of the positions after all of them.
+template <typename Real>
+Bounds transformPass(VertexBuffer<Real>& vbo, std::vector<unsigned int>& ebo, const Options& options)
 {
-    out << v.p.x << ", " << v.p.y << ", " << v.p.z;
-    if (v.hasNorm)
-        out << ", " << v.n.x << ", " << v.n.y << ", " << v.n.z;
-    if (v.hasUV)
-        out << ", " << v.t.x << ", " << v.t.y;
-    return out;
+    if (options.transform)
+        transformVertices(vbo, ebo, options.matrix, options.threads);
+    Bounds bounds = computeBounds(vbo, options.threads);
+    if (options.center) {
+        Transform translation;
+        for (int axis = 0; axis < 3; ++axis)
+            translation.m[axis][3] = -(bounds.min[axis] + bounds.max[axis]) / 2;
+        transformVertices(vbo, ebo, translation, options.threads);
+        bounds = computeBounds(vbo, options.threads);
+    }
+    if (options.normalizeNormals)
+        normalizeNormals(vbo, options.threads);
+    return bounds;
 }
 
-// Tokenize the given line into tokens. Returns the number of tokens parsed,
-// or -1 if there was an invalid parsing of string to T.
-template <typename T>
-int tokenize(T out[], const std::string& line, // The line to tokenize
-             int maxTokens = 3,          // Max number of tokens parsed
-             bool skipFirst = true,      // Skip the first token if true
-             char delim = ' ',           // Delimiter that separates tokens
-             const T& sentinel = T())    // Sentinel placed for empty lines
+// Same as convert, but spills the element indices to a temporary file while
+// parsing and streams them to the output afterwards. Only the attributes and
+// unique vertices are kept in memory, the input itself is a file-backed
+// mapping that the kernel can always reclaim.
+template <typename Real>
+bool convertStreaming(std::string_view text, OutputBuffer& output, const Options& options, RunStats& stats)
 {
-    std::istringstream ss(line), conv;
-    std::string item;
-
-    // Skip the first token in the line if specified
-    if (skipFirst)
-        std::getline(ss, item, delim);
-
-    // Count up to the max tokens, or until no more tokens
-    int count = 0;
-    for (; count < maxTokens && std::getline(ss, item, delim); ++count) {
-        if (item.length() == 0) {
-            // Put sentinel for a blank token
-            out[count] = sentinel;
+    StageTimer timer;
+    VertexBuffer<Real> vbo;
+    IndexSpill ebo;
+    if (!ebo.open()) {
+        std::cerr << "Could not create a temporary file for the indices" << std::endl;
+        return false;
+    }
+    vbo.setAttributes(attributeFlags(options.disableTexture, options.disableNormal));
+    ParseContext<Real> context;
+    bool parsed = objToJsSequential(text, vbo, ebo, context);
+    stats.parsing = context.stats;
+    if (!parsed)
+        return false;
+    stats.parse = timer.lap();
+    stats.vertices = vbo.size();
+    stats.indices = ebo.size();
+
+    // Welding and sorting only renumber the vertices, indices are remapped
+    // as they stream out
+    std::vector<unsigned int> mapping;
+    if (options.weld) {
+        mapping = weldMapping(vbo, options.weldEpsilon, options.threads);
+        stats.welded = stats.vertices - vbo.size();
+    }
+    stats.weld = timer.lap();
+    // A mirroring transform reverses the windings as the indices stream out.
+    // Spilled blocks hold whole triangles.
+    Bounds bounds;
+    std::vector<unsigned int> noIndices;
+    bool flip = options.transform && options.matrix.determinant() < 0;
+    if (transformsVertices(options))
+        bounds = transformPass(vbo, noIndices, options);
+    stats.transform = timer.lap();
+    if (options.sortZX) {
+        std::vector<unsigned int> order = sortVerticesZX(vbo, options.threads);
+        if (mapping.empty()) {
+            mapping.swap(order);
         } else {
-            // Try converting to T
-            conv.str(item);
-            if (!(conv >> out[count]))
-                return -1;
-            conv.clear();
+            for (unsigned int& m : mapping)
+                m = order[m];
         }
     }
-    return count;
+    stats.sort = timer.lap();
+    auto remap = [&mapping, flip](unsigned int* indices, size_t count) {
+        if (!mapping.empty()) {
+            for (size_t i = 0; i < count; ++i)
+                indices[i] = mapping[indices[i]];
+        }
+        if (flip) {
+            for (size_t i = 0; i + 2 < count; i += 3)
+                std::swap(indices[i + 1], indices[i + 2]);
+        }
+    };
+
+    // The vertex array is complete, so the indices can follow it
+    bool ok = !ebo.bad();
+    if (ok && options.format == "bin") {
+        Quantization quantization = quantizationBounds(vbo, options.texcoordEncoding);
+        writeBinaryVertices(output, vbo, ebo.size(), options.quantize ? &quantization : 0, options.encodeIndices);
+        IndexEncoder encoder;
+        ok = ebo.forEachBlock([&](unsigned int* indices, size_t count) {
+            remap(indices, count);
+            if (options.encodeIndices)
+                encoder.encode(output, indices, count);
+            else
+                writeBinaryIndices(output, vbo, indices, count);
+        });
+        if (transformsVertices(options))
+            writeBinaryBounds(output, bounds);
+    } else if (ok) {
+        std::string indent(options.useTabs ? options.tabLevel : 4*options.tabLevel,
+                           options.useTabs ? '\t' : ' ');
+        if (transformsVertices(options))
+            writeBounds<Real>(output, bounds, indent, options.precision);
+        writeVertexArray(output, vbo, indent, options.precision, options.threads);
+        output.write(indent); output.write("// Element Index Array\n");
+        size_t first = 0;
+        ok = ebo.forEachBlock([&](unsigned int* indices, size_t count) {
+            remap(indices, count);
+            writeIndices(output, indices, count, first, indent, options.threads);
+            first += count;
+        });
+        output.put('\n');
+    }
+    if (!ok)
+        std::cerr << "Could not access the temporary index file" << std::endl;
+    stats.emit = timer.lap();
+    reportPeakMemory();
+    return ok;
 }
 
-// Parses the next vertex attribute by the first two letters.
-template <typename V, unsigned int D>
-bool parseVertexAttribute(std::istream& in, std::vector<V>& parsedAttribs,
-                          char category, char type, std::string& prevLine)
+// Parser state saved between --incremental runs
+template <typename Real>
+struct IncrementalState {
+    uint64_t offset = 0;     // End of the last complete line parsed
+    uint64_t prefixHash = 0; // Hash of the first bytes up to the offset
+    uint64_t tailHash = 0;   // Hash of the last bytes before the offset
+    uint64_t indexBase = 0;  // Indices emitted so far
+    ParseContext<Real> context;
+};
+
+// Hashes the first and the last up to 4 KiB of the text before the offset,
+// which tell whether a file still starts with what was parsed
+inline void incrementalHashes(std::string_view text, uint64_t offset, uint64_t hashes[2])
 {
-    double values[D];
-    do {
-        // Skip blank lines and comments
-        if (prevLine.length() < 2 || prevLine[0] == '#')
-            continue;
-        // Stop if we've reached a different attribute
-        else if (prevLine[0] != category || prevLine[1] != type)
-            break;
-        // Parse the texture coordinate data
-        if (tokenize(values, prevLine) <= 0)
-            return false;
-        // Write the parsed attribute
-        V v; double* vptr = &v.x;
-        for (unsigned int i = 0; i < D; ++i)
-            *(vptr + i) = values[i];
-        parsedAttribs.push_back(v);
-    } while (std::getline(in, prevLine));
-    return true;
+    size_t span = std::min<uint64_t>(offset, 4096);
+    hashes[0] = hashBytes(text.data(), span);
+    hashes[1] = hashBytes(text.data() + offset - span, span);
 }
 
-// Reads a .obj file and parses the vertex positions, texture coordinates,
-// normals, and triangulated faces.
-// Returns true on success, otherwise false.
-bool objToJs(std::istream& in, std::vector<Vertex>& vertexData, std::vector<unsigned int>& elementData,
-             bool disableTexture = false, bool disableNormal = false)
-{
-    std::string line;
+// The fixed part of the state file, followed by the positions, texture
+// coordinates, normals and dedup table entries as 4 uint32 each
+struct StateHeader {
+    char magic[4];
+    uint32_t version, realSize, layout;
+    uint64_t offset, prefixHash, tailHash, vertexBase, indexBase;
+    uint64_t positions, texcoords, normals, entries;
+};
 
-    // Read vertex position data
-    std::vector<Vec3> positions;
-    if (!parseVertexAttribute<Vec3,3>(in, positions, 'v', ' ', line)) {
-        std::cerr << "Malformed vertex position: " << line << std::endl;
+// Loads the state saved for the text and the vertex layout. Returns false
+// if there is none, or the text no longer continues what was saved.
+template <typename Real>
+bool loadIncrementalState(const std::string& path, std::string_view text, unsigned int layout,
+                          IncrementalState<Real>& state)
+{
+    InputBuffer input;
+    if (!input.open(path.c_str()))
+        return false;
+    std::string_view data = input.view();
+    StateHeader header;
+    if (data.size() < sizeof(header))
         return false;
-    } else if (!positions.size()) {
-        std::cerr << "Could not parse any vertex positions" << std::endl;
+    std::memcpy(&header, data.data(), sizeof(header));
+    // Counts are checked before multiplying, so a corrupt file can not wrap
+    // the expected size around to the actual one
+    size_t expected = sizeof(header);
+    bool fits = true;
+    auto add = [&](uint64_t count, size_t elementSize) {
+        fits = fits && count <= data.size() / elementSize;
+        expected += fits ? count * elementSize : 0;
+    };
+    add(header.positions, sizeof(Vec3<Real>));
+    add(header.texcoords, sizeof(Vec2<Real>));
+    add(header.normals, sizeof(Vec3<Real>));
+    add(header.entries, 4 * sizeof(uint32_t));
+    uint64_t hashes[2];
+    if (std::memcmp(header.magic, "OBJS", 4) != 0 || header.version != 1 || header.realSize != sizeof(Real)
+            || header.layout != layout || !fits || data.size() != expected || header.offset > text.size())
         return false;
-    } else if (in.eof()) {
-        std::cerr << "Unexpected end of file after vertex positions" << std::endl;
+    incrementalHashes(text, header.offset, hashes);
+    if (hashes[0] != header.prefixHash || hashes[1] != header.tailHash)
         return false;
+
+    state.offset = header.offset;
+    state.indexBase = header.indexBase;
+    ParseContext<Real>& context = state.context;
+    context.vertexBase = static_cast<unsigned int>(header.vertexBase);
+    const char* p = data.data() + sizeof(header);
+    auto read = [&p](auto& values, uint64_t count) {
+        values.resize(count);
+        std::memcpy(values.data(), p, count * sizeof(values[0]));
+        p += count * sizeof(values[0]);
+    };
+    read(context.attribs.positions, header.positions);
+    read(context.attribs.texcoords, header.texcoords);
+    read(context.attribs.normals, header.normals);
+    context.table.reserve(header.entries);
+    for (uint64_t i = 0; i < header.entries; ++i, p += 4 * sizeof(uint32_t)) {
+        uint32_t entry[4];
+        std::memcpy(entry, p, sizeof(entry));
+        context.table.insert({entry[0], entry[1], entry[2]}, entry[3]);
     }
+    return true;
+}
 
-    // Read vertex texture coordinate data
-    std::vector<Vec2> texcoords;
-    if (!parseVertexAttribute<Vec2,2>(in, texcoords, 'v', 't', line)) {
-        std::cerr << "Malformed texture coordinates: " << line << std::endl;
+// Saves the state next to the path and renames it into place, so a run that
+// fails or is interrupted leaves the last state intact
+template <typename Real>
+bool saveIncrementalState(const std::string& path, std::string_view text, unsigned int layout,
+                          const IncrementalState<Real>& state)
+{
+    std::string temporary = path + ".XXXXXX";
+    int fd = mkstemp(&temporary[0]);
+    if (fd < 0)
         return false;
-    } else if (in.eof()) {
-        std::cerr << "Unexpected end of file after texture coordinates" << std::endl;
+    const ParseContext<Real>& context = state.context;
+    const Attributes<Real>& attribs = context.attribs;
+    StateHeader header = {{'O', 'B', 'J', 'S'}, 1, sizeof(Real), layout, state.offset, 0, 0,
+                          context.vertexBase, state.indexBase, attribs.positions.size(),
+                          attribs.texcoords.size(), attribs.normals.size(), context.table.size()};
+    uint64_t hashes[2];
+    incrementalHashes(text, state.offset, hashes);
+    header.prefixHash = hashes[0];
+    header.tailHash = hashes[1];
+
+    bool written;
+    {
+        OutputBuffer output(fd);
+        auto write = [&output](const void* data, size_t bytes) {
+            output.write(std::string_view(static_cast<const char*>(data), bytes));
+        };
+        write(&header, sizeof(header));
+        write(attribs.positions.data(), attribs.positions.size() * sizeof(Vec3<Real>));
+        write(attribs.texcoords.data(), attribs.texcoords.size() * sizeof(Vec2<Real>));
+        write(attribs.normals.data(), attribs.normals.size() * sizeof(Vec3<Real>));
+        context.table.forEach([&](const VertexKey& key, unsigned int index) {
+            const uint32_t entry[4] = {key.v, key.vt, key.vn, index};
+            write(entry, sizeof(entry));
+        });
+        written = output.flush();
+    }
+    written = ::close(fd) == 0 && written;
+    if (!written || rename(temporary.c_str(), path.c_str()) != 0) {
+        ::unlink(temporary.c_str());
         return false;
     }
+    return true;
+}
 
-    // Read vertex normal data
-    std::vector<Vec3> normals;
-    if (!parseVertexAttribute<Vec3,3>(in, normals, 'v', 'n', line)) {
-        std::cerr << "Malformed vertex normals: " << line << std::endl;
+// Same as convert, but only parses the lines appended since the state was
+// saved and writes the new vertices and indices. Indices keep counting from
+// the earlier vertices. The output starts with a line telling where the
+// delta goes, which is the start of the arrays when the text was replaced.
+template <typename Real>
+bool convertIncremental(std::string_view text, OutputBuffer& output, const Options& options, RunStats& stats)
+{
+    StageTimer timer;
+    VertexBuffer<Real> vbo;
+    std::vector<unsigned int> ebo;
+    vbo.setAttributes(attributeFlags(options.disableTexture, options.disableNormal));
+    IncrementalState<Real> state;
+    if (!loadIncrementalState(options.statePath, text, vbo.attribs, state))
+        state = IncrementalState<Real>();
+
+    // A line being appended right now waits for the next run
+    size_t end = text.rfind('\n');
+    end = end == std::string_view::npos || end < state.offset ? state.offset : end + 1;
+    if (!objToJsSequential(text.substr(state.offset, end - state.offset), vbo, ebo, state.context))
         return false;
-    } else if (in.eof()) {
-        std::cerr << "Unexpected end of file after vertex normals" << std::endl;
+    stats.parsing = state.context.stats;
+    stats.parse = timer.lap();
+    stats.vertices = vbo.size();
+    stats.indices = ebo.size();
+    // Only the per-vertex transforms, the delta has no bounds of its own
+    if (transformsVertices(options))
+        transformPass(vbo, ebo, options);
+    stats.transform = timer.lap();
+
+    std::string indent(options.useTabs ? options.tabLevel : 4*options.tabLevel, options.useTabs ? '\t' : ' ');
+    output.write(indent); output.write("// Delta from vertex ");
+    output.writeNumber(state.context.vertexBase);
+    output.write(", index ");
+    output.writeNumber(state.indexBase);
+    output.write("\n");
+    writeArrays(output, vbo, ebo, indent, options.precision, options.threads);
+    stats.emit = timer.lap();
+
+    state.offset = end;
+    state.indexBase += ebo.size();
+    state.context.vertexBase += vbo.size();
+    if (!saveIncrementalState(options.statePath, text, vbo.attribs, state)) {
+        std::cerr << "Could not save the parser state to " << options.statePath << std::endl;
         return false;
     }
+    return true;
+}
 
-    std::string vertices[4];   // Holds 1 triangle or quad
-    std::string* triangles[6]; // Holds up to two triangles
-    unsigned int locations[3];
+// Parses the .obj text, post-processes it and writes it to the output,
+// storing vertex data as Real. Returns true on success, otherwise false.
+// Stage timings and counters are written to stats. Passing a workspace
+// reuses its buffers, and parse errors go to the log of its context.
+template <typename Real>
+bool convert(std::string_view text, OutputBuffer& output, const Options& options, RunStats& stats,
+             Workspace<Real>* workspace = 0)
+{
+    if (options.stream)
+        return convertStreaming<Real>(text, output, options, stats);
+    if (!options.statePath.empty())
+        return convertIncremental<Real>(text, output, options, stats);
 
-    std::unordered_map<std::string, unsigned int> indexCache;
+    // Read and parse the obj file
+    StageTimer timer;
+    Workspace<Real> localWorkspace;
+    Workspace<Real>& work = workspace ? *workspace : localWorkspace;
+    VertexBuffer<Real>& vbo = work.vbo;
+    std::vector<unsigned int>& ebo = work.ebo;
+    vbo.data.clear();
+    ebo.clear();
+    if (!objToJs(text, vbo, ebo, options.disableTexture, options.disableNormal, options.threads,
+                 &stats.parsing, &work.context))
+        return false;
+    stats.parse = timer.lap();
+    stats.vertices = vbo.size();
+    stats.indices = ebo.size();
 
-    do {
-        // Skip lines that do not specify texture coordinates
-        if (line.length() < 2 || line[0] != 'f')
+    // Do post processing of results
+    if (options.generateNormals)
+        stats.split = generateNormals(vbo, ebo, options.creaseAngle, options.threads);
+    stats.normals = timer.lap();
+    if (options.weld)
+        stats.welded = weldVertices(vbo, ebo, options.weldEpsilon, options.threads);
+    stats.weld = timer.lap();
+    Bounds bounds;
+    if (transformsVertices(options))
+        bounds = transformPass(vbo, ebo, options);
+    stats.transform = timer.lap();
+    if (options.sortZX)
+        sortZX(vbo, ebo, options.threads);
+    stats.sort = timer.lap();
+    if (options.cacheSize) {
+        stats.acmrBefore = vertexCacheMissRatio(ebo, vbo.size(), options.cacheSize);
+        optimizeVertexCache(ebo, vbo.size(), options.cacheSize);
+        optimizeVertexFetch(vbo, ebo);
+        stats.acmrAfter = vertexCacheMissRatio(ebo, vbo.size(), options.cacheSize);
+    }
+    stats.optimize = timer.lap();
+    // The levels share the final vertex order, and get their own triangle order
+    std::vector<std::vector<unsigned int>> lods;
+    if (!options.lods.empty()) {
+        lods = buildLods(vbo, ebo, options.lods, options.threads);
+        for (std::vector<unsigned int>& lod : lods) {
+            if (options.cacheSize)
+                optimizeVertexCache(lod, vbo.size(), options.cacheSize);
+            stats.lodTriangles.push_back(lod.size() / 3);
+        }
+    }
+    stats.simplify = timer.lap();
+    std::vector<Meshlet> meshlets;
+    if (options.meshlets) {
+        meshlets = buildMeshlets(vbo, ebo, options.meshletVertices, options.meshletTriangles, options.threads);
+        stats.meshlets = meshlets.size();
+    }
+    stats.partition = timer.lap();
+
+    // Configure and write output
+    if (options.format == "bin") {
+        Quantization quantization;
+        if (options.quantize)
+            quantization = quantizationBounds(vbo, options.texcoordEncoding);
+        writeBinary(output, vbo, ebo, options.quantize ? &quantization : 0, options.encodeIndices);
+        if (transformsVertices(options))
+            writeBinaryBounds(output, bounds);
+        if (options.meshlets)
+            writeBinaryMeshlets(output, meshlets);
+        if (!lods.empty())
+            writeBinaryLods(output, vbo, lods, options.encodeIndices);
+    } else {
+        std::string indent(options.useTabs ? options.tabLevel : 4*options.tabLevel,
+                           options.useTabs ? '\t' : ' ');
+        if (transformsVertices(options))
+            writeBounds<Real>(output, bounds, indent, options.precision);
+        writeArrays(output, vbo, ebo, indent, options.precision, options.threads);
+        if (options.meshlets)
+            writeMeshlets(output, meshlets, indent, options.precision);
+        writeLods(output, lods, indent, options.threads);
+    }
+    stats.emit = timer.lap();
+    return true;
+}
+
+// Formats the value as a hex float, which keeps every bit of it
+std::string exactText(double value)
+{
+    char text[32];
+    std::snprintf(text, sizeof(text), "%a", value);
+    return text;
+}
+
+// Gets the name of the cache entry for converting the text with the options:
+// a hash of the text, seeded with a hash of everything else that changes the
+// output. Thread counts and --stream do not. Doubles are written exactly, so
+// options that differ anywhere get their own entries.
+template <typename Real>
+std::string cacheEntryName(std::string_view text, const Options& options)
+{
+    std::ostringstream settings;
+    settings << "objtoarr 2 " << sizeof(Real) << ' ' << options.disableTexture << options.disableNormal << ' '
+             << options.tabLevel << options.useTabs << ' ' << options.precision << ' ' << options.sortZX << ' '
+             << options.weld << exactText(options.weldEpsilon) << ' ' << options.format << ' ' << options.cacheSize
+             << ' ' << options.quantize << options.texcoordEncoding << options.encodeIndices << ' ' << options.meshlets
+             << options.meshletVertices << ',' << options.meshletTriangles << ' ' << options.compression << ' '
+             << options.center << options.normalizeNormals << options.transform << ' ' << options.generateNormals
+             << exactText(options.creaseAngle) << " lod";
+    for (double ratio : options.lods)
+        settings << ',' << exactText(ratio);
+    for (const auto& row : options.matrix.m)
+        for (double value : row)
+            settings << ',' << exactText(value);
+    std::string key = settings.str();
+    uint64_t hash = hashBytes(text.data(), text.size(), hashBytes(key.data(), key.size()));
+    char name[32];
+    std::snprintf(name, sizeof(name), "%016llx.%s%s", static_cast<unsigned long long>(hash),
+                  options.format == "bin" ? "bin" : "txt", compressionSuffix(options.compression));
+    return name;
+}
+
+// Copies the whole file to the output: as a reflink where the file system
+// can share the extents, else in the kernel with sendfile, else by reading
+// and writing. Returns the number of bytes copied, or -1 on failure.
+long long copyFile(int from, int to)
+{
+    struct stat st;
+    if (fstat(from, &st) != 0)
+        return -1;
+    // Cloning replaces the whole file, so the output must be empty so far
+    if (lseek(to, 0, SEEK_CUR) == 0 && ioctl(to, FICLONE, from) == 0)
+        return lseek(to, st.st_size, SEEK_SET) == st.st_size ? st.st_size : -1;
+    off_t offset = 0;
+    while (offset < st.st_size) {
+        ssize_t n = sendfile(to, from, &offset, st.st_size - offset);
+        if (n < 0 && errno == EINTR)
             continue;
+        if (n < 0 && offset == 0 && (errno == EINVAL || errno == ENOSYS))
+            break;
+        if (n <= 0)
+            return -1;
+    }
+    if (offset == st.st_size)
+        return offset;
+    InputBuffer input;
+    OutputBuffer output(to);
+    if (!input.read(from))
+        return -1;
+    output.write(input.view());
+    return output.flush() ? static_cast<long long>(output.bytesWritten()) : -1;
+}
 
-        // Parse the texture coordinate data
-        int deg = tokenize(vertices, line, 4);
-        if (deg != 3 && deg != 4) {
-            std::cerr << "All faces must be triangles or quads: " << line << std::endl;
+// Same as convert, but through the cache directory. A miss converts into a
+// temporary file there and renames it to the entry, so concurrent runs only
+// ever see complete entries. The entry is then copied to the output.
+// Errors go to the log.
+template <typename Real>
+bool convertCached(std::string_view text, int outputFd, const Options& options, RunStats& stats,
+                   std::ostream& log, Workspace<Real>* workspace = 0)
+{
+    std::string entry = options.cacheDir + "/" + cacheEntryName<Real>(text, options);
+    int fd = ::open(entry.c_str(), O_RDONLY);
+    stats.cached = fd >= 0;
+    if (fd < 0) {
+        std::string temporary = entry + ".XXXXXX";
+        int temporaryFd = mkstemp(&temporary[0]);
+        if (temporaryFd < 0) {
+            log << "Could not write to cache " << options.cacheDir << std::endl;
             return false;
         }
-
-        // Get the triangles in this face
-        int vertexCount = 3;
-        triangles[0] = vertices; triangles[1] = vertices + 1; triangles[2] = vertices + 2;
-        if (deg == 4) { // Triangulate quads
-            vertexCount = 6;
-            triangles[3] = vertices; triangles[4] = vertices + 2; triangles[5] = vertices + 3;
+        bool converted, written;
+        {
+            OutputBuffer output(temporaryFd);
+            output.compress(options.compression);
+            converted = convert<Real>(text, output, options, stats, workspace);
+            written = output.flush();
         }
-
-        for (int i = 0; i < vertexCount; ++i) {
-            const std::string& v = *(triangles[i]);
-
-            // Search for an already created index for this vertex
-            auto it = indexCache.find(v);
-            if (it != indexCache.end()) {
-                elementData.push_back(it->second);
-            } else {
-                // Create a new entry in the vertex buffer
-                // Get the locations referenced by this vertex
-                int attrs = tokenize(locations, v, 3, false, '/');
-                if (attrs <= 0) {
-                    std::cerr << "Malformed vertex " << v << std::endl;
-                    return false;
-                }
-
-                // Get the vertex data
-                Vec3 pos = positions[locations[0] - 1];
-                Vec2 tex;
-                if (locations[1] > 0)
-                    tex = texcoords[locations[1] - 1];
-                Vec3 norm;
-                if (locations[2] > 0)
-                    norm = normals[locations[2] - 1];
-
-                // Enter and cache the vertex
-                elementData.push_back(vertexData.size());
-                indexCache[v] = vertexData.size();
-                vertexData.push_back({!disableNormal, !disableTexture, pos, norm, tex});
-            }
+        written = fchmod(temporaryFd, 0644) == 0 && written;
+        written = ::close(temporaryFd) == 0 && written;
+        if (!converted || !written || rename(temporary.c_str(), entry.c_str()) != 0) {
+            ::unlink(temporary.c_str());
+            if (converted)
+                log << "Could not write to cache " << options.cacheDir << std::endl;
+            return false;
         }
-    } while (std::getline(in, line));
+        fd = ::open(entry.c_str(), O_RDONLY);
+    }
+
+    StageTimer timer;
+    long long copied = fd >= 0 ? copyFile(fd, outputFd) : -1;
+    if (fd >= 0)
+        ::close(fd);
+    stats.emit += timer.lap();
+    if (copied < 0) {
+        log << "Could not write output" << std::endl;
+        return false;
+    }
+    stats.bytesWritten = copied;
+    return true;
+}
+
+// Batch jobs queued for one worker. The owner takes jobs from the front and
+// idle workers steal from the back, so each worker mostly converts a
+// contiguous run of files while load stays balanced.
+class JobQueue {
+public:
+    void push(size_t job)
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        jobs.push_back(job);
+    }
+
+    bool pop(size_t& job)
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (jobs.empty())
+            return false;
+        job = jobs.front();
+        jobs.pop_front();
+        return true;
+    }
+
+    bool steal(size_t& job)
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (jobs.empty())
+            return false;
+        job = jobs.back();
+        jobs.pop_back();
+        return true;
+    }
 
+private:
+    std::mutex mutex;
+    std::deque<size_t> jobs;
+};
+
+// Expands the --batch value into input paths. A value with wildcards is a
+// glob pattern, anything else is a file listing one path per line.
+// Returns false if the list can not be read.
+bool batchInputs(const std::string& spec, std::vector<std::string>& paths)
+{
+    if (spec.find_first_of("*?[") != std::string::npos) {
+        glob_t matches;
+        int result = glob(spec.c_str(), 0, 0, &matches);
+        for (size_t i = 0; result == 0 && i < matches.gl_pathc; ++i)
+            paths.push_back(matches.gl_pathv[i]);
+        globfree(&matches);
+        return result == 0 || result == GLOB_NOMATCH;
+    }
+    InputBuffer list;
+    if (!list.open(spec.c_str()))
+        return false;
+    LineReader in(list.view());
+    std::string_view line;
+    while (in.next(line)) {
+        if (!line.empty())
+            paths.emplace_back(line);
+    }
     return true;
 }
 
-// Sorts the data and remaps the indices such that the data is sorted by
-// position Z then X value.
-void sortZX(std::vector<Vertex>& data, std::vector<unsigned int>& indices)
+// Gets the output path of a batch input: its file name with the extension
+// (and any compression suffix) replaced for the output, in the output
+// directory or next to the input
+std::string batchOutputPath(const std::string& input, const std::string& outDir, const Options& options)
 {
-    // Double comparison
-    auto isEqual = [](double a, double b) {
-        return std::abs(a - b) < 1e-10;
-    };
-    unsigned int N = data.size();
+    size_t slash = input.rfind('/');
+    size_t start = slash == std::string::npos ? 0 : slash + 1;
+    Compression inputCompression;
+    parseCompression(input, true, inputCompression);
+    size_t stem = input.size() - std::strlen(compressionSuffix(inputCompression));
+    size_t dot = input.rfind('.', stem - 1);
+    size_t end = dot == std::string::npos || dot <= start ? stem : dot;
+    std::string dir = outDir.empty() ? input.substr(0, start) : outDir + "/";
+    return dir + input.substr(start, end - start) + (options.format == "bin" ? ".bin" : ".txt")
+        + compressionSuffix(options.compression);
+}
 
-    // Build an indexed copy of the data
-    typedef std::pair<unsigned int, Vertex> IndexedVert;
-    std::vector<IndexedVert> sortedData(N);
-    for (unsigned int i = 0; i < N; ++i) {
-        sortedData[i] = std::make_pair(i, data[i]);
+// Converts one batch file with the buffers of the calling worker.
+// Returns the error message, or an empty string on success.
+template <typename Real>
+std::string convertFile(const std::string& inputPath, const std::string& outputPath,
+                        const Options& options, Workspace<Real>& workspace,
+                        InputBuffer& input, OutputBuffer& output)
+{
+    if (!input.open(inputPath.c_str()))
+        return "Could not open file " + inputPath;
+    if (const char* error = input.decompress())
+        return error;
+    int fd = ::open(outputPath.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0666);
+    if (fd < 0)
+        return "Could not open file " + outputPath;
+
+    std::ostringstream log;
+    workspace.context.log = &log;
+    RunStats stats;
+    bool converted, written = true;
+    if (!options.cacheDir.empty()) {
+        converted = convertCached<Real>(input.view(), fd, options, stats, log, &workspace);
+    } else {
+        output.reopen(fd);
+        output.compress(options.compression);
+        converted = convert<Real>(input.view(), output, options, stats, &workspace);
+        written = output.flush();
     }
+    written = ::close(fd) == 0 && written;
+    if (!converted) {
+        ::unlink(outputPath.c_str());
+        std::string message = log.str();
+        while (!message.empty() && message.back() == '\n')
+            message.pop_back();
+        return message;
+    }
+    return written ? std::string() : "Could not write output " + outputPath;
+}
 
-    // Sort the data by z, x
-    std::sort(sortedData.begin(), sortedData.end(), [&isEqual](IndexedVert& v1, IndexedVert& v2) {
-        Vec3 &p1 = v1.second.p, &p2 = v2.second.p;
-        return p1.z < p2.z || (isEqual(p1.z, p2.z) && p1.x < p2.x);
+// Converts all inputs on the given number of workers. Failures are
+// reported in input order once every file is done. Inputs that would write
+// the output of an earlier input, such as files of the same name from two
+// directories, fail without being converted.
+// Returns the exit code of the program.
+template <typename Real>
+int convertBatch(const std::vector<std::string>& inputs, const std::string& outDir,
+                 unsigned int jobs, const Options& options)
+{
+    std::vector<std::string> outputs(inputs.size()), errors(inputs.size());
+    std::unordered_map<std::string, size_t> writers;
+    for (size_t i = 0; i < inputs.size(); ++i) {
+        outputs[i] = batchOutputPath(inputs[i], outDir, options);
+        auto writer = writers.emplace(outputs[i], i);
+        if (!writer.second)
+            errors[i] = "Same output " + outputs[i] + " as " + inputs[writer.first->second];
+    }
+
+    jobs = std::max<size_t>(1, std::min<size_t>(jobs, inputs.size()));
+    std::vector<JobQueue> queues(jobs);
+    for (unsigned int t = 0; t < jobs; ++t) {
+        auto range = splitRange(inputs.size(), t, jobs);
+        for (size_t i = range.first; i < range.second; ++i) {
+            if (errors[i].empty())
+                queues[t].push(i);
+        }
+    }
+
+    runParallel(jobs, [&](unsigned int t) {
+        Workspace<Real> workspace;
+        InputBuffer input;
+        OutputBuffer output(-1);
+        size_t job;
+        for (;;) {
+            bool found = queues[t].pop(job);
+            for (unsigned int k = 1; !found && k < jobs; ++k)
+                found = queues[(t + k) % jobs].steal(job);
+            if (!found)
+                break;
+            errors[job] = convertFile(inputs[job], outputs[job], options, workspace, input, output);
+        }
     });
 
-    // Build the index mapping and copy sorted data
-    std::vector<unsigned int> mapping(N);
-    for (unsigned int i = 0; i < N; ++i) {
-        auto& pair = sortedData[i];
-        mapping[pair.first] = i;
-        data[i] = pair.second;
+    size_t failed = 0;
+    for (size_t i = 0; i < inputs.size(); ++i) {
+        if (!errors[i].empty()) {
+            std::cerr << inputs[i] << ": " << errors[i] << std::endl;
+            ++failed;
+        }
+    }
+    std::cerr << "Converted " << inputs.size() - failed << " of " << inputs.size() << " files" << std::endl;
+    return failed ? -1 : 0;
+}
+
+// Accepted connections waiting for a server worker. Once closed, workers
+// get -1 when no connection is left.
+class ConnectionQueue {
+public:
+    void push(int fd)
+    {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            fds.push_back(fd);
+        }
+        ready.notify_one();
+    }
+
+    int pop()
+    {
+        std::unique_lock<std::mutex> lock(mutex);
+        ready.wait(lock, [this] { return !fds.empty() || closed; });
+        if (fds.empty())
+            return -1;
+        int fd = fds.front();
+        fds.pop_front();
+        return fd;
+    }
+
+    void close()
+    {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            closed = true;
+        }
+        ready.notify_all();
+    }
+
+private:
+    std::mutex mutex;
+    std::condition_variable ready;
+    std::deque<int> fds;
+    bool closed = false;
+};
+
+// Vertices the buffers of a server worker are sized for up front
+const size_t ServeVertices = 1 << 16;
+
+// Buffers of one server worker, allocated before the first request and kept
+// between requests
+template <typename Real>
+struct ServeWorker {
+    ServeWorker()
+    {
+        workspace.context.table.reserve(ServeVertices);
+        workspace.vbo.data.reserve(8 * ServeVertices);
+        workspace.ebo.reserve(6 * ServeVertices);
     }
 
-    // Write the mapped indices
-    for (unsigned int& i : indices) {
-        i = mapping[i];
+    Workspace<Real> workspace;
+    InputBuffer input;
+    OutputBuffer output; // The conversion result of the request
+};
+
+// Answers the conversion requests read from one descriptor on the other,
+// until the input ends or a response can not be written. A request is a
+// uint64 byte count and the bytes of an obj file, which may be compressed.
+// A response is a uint32 status, 0 if converted and 1 if not, a uint64 byte
+// count and the output or the error message. All numbers are little-endian.
+template <typename Real>
+void serveRequests(int in, int out, const Options& options, bool printStats, ServeWorker<Real>& worker)
+{
+    OutputBuffer response(out, 1 << 12);
+    for (;;) {
+        uint64_t size;
+        if (!worker.input.read(in, sizeof(size)))
+            return;
+        std::memcpy(&size, worker.input.view().data(), sizeof(size));
+        StageTimer timer;
+        RunStats stats;
+        if (!worker.input.read(in, size))
+            return;
+        stats.bytesRead = size;
+        const char* error = worker.input.decompress();
+        stats.read = timer.lap();
+
+        std::ostringstream log;
+        worker.workspace.context.log = &log;
+        worker.output.clear();
+        bool converted = !error && convert<Real>(worker.input.view(), worker.output, options, stats,
+                                                 &worker.workspace);
+        timer.lap(); // Convert timed its own stages
+        std::string message = error ? error : log.str();
+        while (!message.empty() && message.back() == '\n')
+            message.pop_back();
+        if (message.empty())
+            message = "Could not convert";
+        std::string_view result = converted ? worker.output.view() : std::string_view(message);
+        writeLittleEndian(response, converted ? 0u : 1u);
+        writeLittleEndian(response, static_cast<uint32_t>(result.size()));
+        writeLittleEndian(response, static_cast<uint32_t>(uint64_t(result.size()) >> 32));
+        response.write(result);
+        if (!response.flush())
+            return;
+        stats.emit += timer.lap();
+        stats.bytesWritten = result.size();
+        if (printStats && converted)
+            reportStats(stats);
     }
 }
 
-// Parses arguments into a dictionary and strips out any '=\d+' suffix into
-// the value of the dictionary entry
-void parseArguments(std::unordered_map<std::string, int>& parsedArgs,
-                    int numArgs, char** args, int offset = 1)
+// Answers requests on standard input and output, or with a socket path, on
+// every connection to a Unix socket there. Each of the workers serves one
+// connection at a time with its own buffers, and further connections wait.
+// Returns the exit code of the program.
+template <typename Real>
+int serve(const std::string& path, unsigned int workers, const Options& options, bool printStats)
 {
-    for (int i = offset; i < numArgs; ++i) {
-        std::string arg(args[i]);
-        // Skip non-arguments
-        if (arg[0] != '-' || arg[1] != '-')
-            continue;
-        // Try parsing the digit
-        int digit = 1;
-        size_t eqIndex = arg.find_last_of('=');
-        if (eqIndex != std::string::npos) {
-            digit = std::atoi(arg.substr(eqIndex + 1).c_str());
-        }
-        // Add the argument to the dictionary
-        parsedArgs[arg.substr(0, eqIndex)] = digit;
+    // A client that goes away only ends its own connection
+    std::signal(SIGPIPE, SIG_IGN);
+    if (path.empty()) {
+        ServeWorker<Real> worker;
+        serveRequests(STDIN_FILENO, STDOUT_FILENO, options, printStats, worker);
+        return 0;
+    }
+
+    sockaddr_un address = {};
+    address.sun_family = AF_UNIX;
+    if (path.size() >= sizeof(address.sun_path)) {
+        std::cerr << "Socket path too long: " << path << std::endl;
+        return -1;
     }
+    std::memcpy(address.sun_path, path.c_str(), path.size() + 1);
+    // Replace the socket of a server that was stopped
+    struct stat status;
+    if (lstat(path.c_str(), &status) == 0 && S_ISSOCK(status.st_mode))
+        ::unlink(path.c_str());
+    int listener = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (listener < 0 || bind(listener, reinterpret_cast<sockaddr*>(&address), sizeof(address)) != 0
+            || listen(listener, SOMAXCONN) != 0) {
+        std::cerr << "Could not listen on " << path << std::endl;
+        if (listener >= 0)
+            ::close(listener);
+        return -1;
+    }
+    std::cerr << "Serving on " << path << " with " << workers << " workers" << std::endl;
+
+    ConnectionQueue connections;
+    runParallel(workers + 1, [&](unsigned int t) {
+        if (t == 0) {
+            for (;;) {
+                int fd = accept4(listener, 0, 0, SOCK_CLOEXEC);
+                if (fd >= 0)
+                    connections.push(fd);
+                else if (errno != EINTR && errno != ECONNABORTED)
+                    break;
+            }
+            std::cerr << "Could not accept connections on " << path << std::endl;
+            connections.close();
+            return;
+        }
+        ServeWorker<Real> worker;
+        for (int fd; (fd = connections.pop()) >= 0; ::close(fd))
+            serveRequests(fd, fd, options, printStats, worker);
+    });
+    ::close(listener);
+    ::unlink(path.c_str());
+    return -1;
 }
 
 int main(int argc, char* argv[])
 {
-    std::fstream files[2];
+    // Parse arguments
+    std::unordered_map<std::string, Argument> parsedArgs;
+    parseArguments(parsedArgs, argc, argv);
+
+    // Configure program from arguments
+    Options options;
+    options.disableTexture = parsedArgs.count("--no-texture");
+    options.disableNormal = parsedArgs.count("--no-normal");
+    options.tabLevel = parsedArgs.count("--indent") ? parsedArgs["--indent"].value : 0;
+    options.useTabs = parsedArgs.count("--use-tabs");
+    options.precision = parsedArgs.count("--precision") ? parsedArgs["--precision"].value : 5;
+    // More digits than a double holds add nothing, and all negative values
+    // ask for the shortest form
+    options.precision = std::max(-1, std::min(options.precision, std::numeric_limits<double>::max_digits10));
+    options.sortZX = parsedArgs.count("--sort-zx");
+    int threads = parsedArgs.count("--threads") ? parsedArgs["--threads"].value : 1;
+    options.threads = threads > 0 ? threads : std::max(1u, std::thread::hardware_concurrency());
+    options.format = parsedArgs.count("--format") ? parsedArgs["--format"].text : "text";
+    options.stream = parsedArgs.count("--stream");
+    if (parsedArgs.count("--optimize-cache")) {
+        const Argument& cache = parsedArgs["--optimize-cache"];
+        options.cacheSize = cache.text.empty() ? 16 : std::max(1, cache.value);
+    }
+    if (parsedArgs.count("--quantize")) {
+        const std::string& encoding = parsedArgs["--quantize"].text;
+        options.quantize = true;
+        if (encoding == "unorm16") {
+            options.texcoordEncoding = TexcoordUnorm16;
+        } else if (!encoding.empty() && encoding != "half") {
+            std::cerr << "Unknown texture coordinate encoding " << encoding << std::endl;
+            return -1;
+        }
+    }
+    options.encodeIndices = parsedArgs.count("--encode-indices");
+    if (options.encodeIndices && options.format != "bin") {
+        std::cerr << "--encode-indices needs --format=bin" << std::endl;
+        return -1;
+    }
+    if (parsedArgs.count("--weld")) {
+        options.weld = true;
+        options.weldEpsilon = std::atof(parsedArgs["--weld"].text.c_str());
+        if (!(options.weldEpsilon >= 0)) {
+            std::cerr << "--weld needs a tolerance of 0 or more" << std::endl;
+            return -1;
+        }
+    }
+    if (parsedArgs.count("--gen-normals")) {
+        const std::string& angle = parsedArgs["--gen-normals"].text;
+        options.generateNormals = true;
+        options.creaseAngle = angle.empty() ? 180 : std::atof(angle.c_str());
+        if (!(options.creaseAngle >= 0 && options.creaseAngle <= 180)) {
+            std::cerr << "--gen-normals needs a crease angle from 0 to 180 degrees" << std::endl;
+            return -1;
+        }
+        if (options.disableNormal || options.stream) {
+            std::cerr << "--gen-normals can not be combined with --no-normal or --stream" << std::endl;
+            return -1;
+        }
+    }
+    options.center = parsedArgs.count("--center");
+    options.normalizeNormals = parsedArgs.count("--normalize-normals");
+    if (parsedArgs.count("--transform")) {
+        options.transform = true;
+        if (!parseTransform(parsedArgs["--transform"].text, options.matrix)) {
+            std::cerr << "--transform needs a scale, or 12 or 16 numbers of an affine matrix" << std::endl;
+            return -1;
+        }
+    }
+    if (parsedArgs.count("--meshlets")) {
+        // Either limit can be left out, as in --meshlets=128 or --meshlets=,64
+        const std::string& limits = parsedArgs["--meshlets"].text;
+        size_t comma = limits.find(',');
+        std::string vertices = limits.substr(0, comma);
+        std::string triangles = comma == std::string::npos ? "" : limits.substr(comma + 1);
+        options.meshlets = true;
+        if (!vertices.empty())
+            options.meshletVertices = std::max(3, std::atoi(vertices.c_str()));
+        if (!triangles.empty())
+            options.meshletTriangles = std::max(1, std::atoi(triangles.c_str()));
+    }
+    if (parsedArgs.count("--lod")) {
+        // Every level needs fewer triangles than the one before
+        const std::string& ratios = parsedArgs["--lod"].text;
+        const char* p = ratios.c_str();
+        double previous = 1;
+        for (;;) {
+            char* end;
+            double ratio = std::strtod(p, &end);
+            if (end == p || (*end && *end != ',') || !(ratio > 0 && ratio < previous)) {
+                std::cerr << "--lod needs comma separated triangle ratios between 0 and 1, each below the last"
+                          << std::endl;
+                return -1;
+            }
+            options.lods.push_back(ratio);
+            previous = ratio;
+            if (!*end)
+                break;
+            p = end + 1;
+        }
+        if (options.meshlets || options.stream) {
+            std::cerr << "--lod can not be combined with --meshlets or --stream" << std::endl;
+            return -1;
+        }
+    }
+    if (options.format != "text" && options.format != "bin") {
+        std::cerr << "Unknown output format " << options.format << std::endl;
+        return -1;
+    }
+    if (options.quantize && options.format != "bin") {
+        std::cerr << "--quantize needs --format=bin" << std::endl;
+        return -1;
+    }
+    if (options.cacheSize && options.sortZX) {
+        std::cerr << "--optimize-cache and --sort-zx both reorder the vertices" << std::endl;
+        return -1;
+    }
+    if (options.meshlets && (options.sortZX || options.cacheSize)) {
+        std::cerr << "--meshlets orders the vertices itself and can not be combined with "
+                     "--sort-zx or --optimize-cache" << std::endl;
+        return -1;
+    }
+    bool compressionNamed = parsedArgs.count("--compress");
+    if (compressionNamed && !parseCompression(parsedArgs["--compress"].text, false, options.compression)) {
+        std::cerr << "Unknown compression " << parsedArgs["--compress"].text << std::endl;
+        return -1;
+    }
+    if (!compressionSupported(options.compression)) {
+        std::cerr << "This build can not write " << parsedArgs["--compress"].text << " output" << std::endl;
+        return -1;
+    }
+    if (parsedArgs.count("--cache")) {
+        options.cacheDir = parsedArgs["--cache"].text;
+        if (options.cacheDir.empty() || (mkdir(options.cacheDir.c_str(), 0777) != 0 && errno != EEXIST)) {
+            std::cerr << "Could not create cache directory " << options.cacheDir << std::endl;
+            return -1;
+        }
+    }
+    if (parsedArgs.count("--incremental")) {
+        options.statePath = parsedArgs["--incremental"].text;
+        bool reorders = options.sortZX || options.cacheSize || options.meshlets || options.weld;
+        if (options.statePath.empty() || reorders || options.generateNormals || options.center
+                || !options.lods.empty() || options.stream || options.format != "text" || !options.cacheDir.empty()
+                || parsedArgs.count("--batch")) {
+            std::cerr << "--incremental needs a state file and text output, and can not be combined with "
+                         "options that renumber vertices, --gen-normals, --center, --lod, --stream, --cache or "
+                         "--batch" << std::endl;
+            return -1;
+        }
+    }
+    if (parsedArgs.count("--serve")) {
+        if (parsedArgs.count("--batch") || !options.statePath.empty() || !options.cacheDir.empty()
+                || options.compression != CompressionNone || options.stream) {
+            std::cerr << "--serve can not be combined with --batch, --incremental, --cache, --compress or "
+                         "--stream" << std::endl;
+            return -1;
+        }
+    }
+    if (parsedArgs.count("--batch") && options.stream) {
+        std::cerr << "--batch can not be combined with --stream" << std::endl;
+        return -1;
+    }
+    if (options.meshlets && options.stream) {
+        std::cerr << "--meshlets needs all indices in memory and can not --stream" << std::endl;
+        return -1;
+    }
+    if (options.cacheSize && options.stream) {
+        std::cerr << "--optimize-cache needs all indices in memory and can not --stream" << std::endl;
+        return -1;
+    }
+
+    // Convert with the requested working precision. Printing more digits
+    // than a float holds would only show its rounding error.
+    bool useDouble = parsedArgs.count("--double")
+        || options.precision > std::numeric_limits<float>::digits10;
+
+    // Convert many files on a pool of workers
+    int jobs = parsedArgs.count("--jobs") ? parsedArgs["--jobs"].value : 0;
+    unsigned int workers = jobs > 0 ? jobs : std::max(1u, std::thread::hardware_concurrency());
+    if (parsedArgs.count("--batch")) {
+        const std::string& list = parsedArgs["--batch"].text;
+        std::vector<std::string> inputs;
+        if (!batchInputs(list, inputs)) {
+            std::cerr << "Could not read batch list " << list << std::endl;
+            return -1;
+        }
+        std::string outDir = parsedArgs.count("--out-dir") ? parsedArgs["--out-dir"].text : "";
+        return useDouble ? convertBatch<double>(inputs, outDir, workers, options)
+                         : convertBatch<float>(inputs, outDir, workers, options);
+    }
+
+    // Keep converting requests with warm buffers, without a process for each
+    if (parsedArgs.count("--serve")) {
+        const std::string& path = parsedArgs["--serve"].text;
+        bool printStats = parsedArgs.count("--stats");
+        return useDouble ? serve<double>(path, workers, options, printStats)
+                         : serve<float>(path, workers, options, printStats);
+    }
+
+    StageTimer timer;
+    RunStats stats;
+    InputBuffer input;
+    bool hasInput = false;
+    int outputFd = STDOUT_FILENO;
     // Try to get the first two arguments as files
     for (int i = 0; i < 2; ++i) {
         // Try to read the file if it's not an argument
         char* a = argc > i+1 ? argv[i+1] : 0;
         if (a && a[0] != '-' && a[1] != '-') {
-            // Read from first, write to second
-            files[i].open(a, !i ? std::fstream::in : std::fstream::out);
-            if (!files[i].is_open()) {
+            // Map the first, write to second
+            bool opened = !i ? (hasInput = input.open(a))
+                             : (outputFd = ::open(a, O_WRONLY | O_CREAT | O_TRUNC, 0666)) >= 0;
+            if (!opened) {
                 std::cerr << "Could not open file " << a << std::endl;
                 return -1;
             }
+            // Compress to a .gz or .zst output unless told otherwise
+            if (i && !compressionNamed)
+                parseCompression(a, true, options.compression);
         }
     }
-    std::istream& input = files[0].is_open() ? files[0] : std::cin;
-    std::ostream& output = files[1].is_open() ? files[1] : std::cout;
-
-    // Parse remaining arguments
-    std::unordered_map<std::string, int> parsedArgs;
-    parseArguments(parsedArgs, argc, argv);
-
-    // Configure program from arguments
-    bool disableTexture = parsedArgs.count("--no-texture");
-    bool disableNormal = parsedArgs.count("--no-normal");
-    int tabLevel = parsedArgs.count("--indent") ? parsedArgs["--indent"] : 0;
-    bool useTabs = parsedArgs.count("--use-tabs");
-    int precision = parsedArgs.count("--precision") ? parsedArgs["--precision"] : 5;
-    bool doSortZX = parsedArgs.count("--sort-zx");
-
-    // Read and parse the obj file
-    std::vector<Vertex> vbo;
-    std::vector<unsigned int> ebo;
-    if (!objToJs(input, vbo, ebo, disableTexture, disableNormal))
+    // Fall back to reading all of stdin
+    if (!hasInput && !input.read(STDIN_FILENO)) {
+        std::cerr << "Could not read from standard input" << std::endl;
         return -1;
+    }
+    // Decompressing is part of reading
+    stats.bytesRead = input.view().size();
+    if (const char* error = input.decompress()) {
+        std::cerr << error << std::endl;
+        return -1;
+    }
+    stats.read = timer.lap();
+    if (!compressionSupported(options.compression)) {
+        std::cerr << "This build can not write " << compressionSuffix(options.compression) << " output"
+                  << std::endl;
+        return -1;
+    }
 
-    // Do post processing of results
-    if (doSortZX)
-        sortZX(vbo, ebo);
-
-    // Configure output
-    std::string indent(useTabs ? tabLevel : 4*tabLevel, useTabs ? '\t' : ' ');
-    output.precision(precision);
+    // Copy cached output, or convert into the cache first
+    if (!options.cacheDir.empty()) {
+        bool converted = useDouble
+            ? convertCached<double>(input.view(), outputFd, options, stats, std::cerr)
+            : convertCached<float>(input.view(), outputFd, options, stats, std::cerr);
+        if (!converted)
+            return -1;
+        if (outputFd != STDOUT_FILENO && ::close(outputFd) != 0) {
+            std::cerr << "Could not write output" << std::endl;
+            return -1;
+        }
+        if (parsedArgs.count("--stats"))
+            reportStats(stats);
+        return 0;
+    }
 
-    // Output the vertex buffer array
-    output << indent << "// Vertex Buffer Object\n";
-    for (auto& v : vbo) {
-        output << indent << v << ",\n";
+    OutputBuffer output(outputFd);
+    output.compress(options.compression);
+    bool converted = useDouble
+        ? convert<double>(input.view(), output, options, stats)
+        : convert<float>(input.view(), output, options, stats);
+    if (!converted)
+        return -1;
+    timer.lap(); // Convert timed its own stages
+    if (options.weld)
+        std::cerr << "Welded " << stats.welded << " of " << stats.vertices << " vertices" << std::endl;
+    if (options.cacheSize) {
+        std::cerr << "Vertex cache ACMR: " << stats.acmrBefore << " before, " << stats.acmrAfter
+                  << " after (FIFO of " << options.cacheSize << ")" << std::endl;
     }
-    output << std::endl;
-    // Output the element index array
-    output << indent << "// Element Index Array\n";
-    for (size_t i = 0, N = (size_t)ebo.size(); i < N; ++i) {
-        if (i % 3 == 0)
-            output << indent;
-        output << ebo[i] << ','  << (i % 3 == 2 ? '\n' : ' ');
+    if (!stats.lodTriangles.empty()) {
+        std::cerr << "Levels of detail of " << stats.indices / 3 << " triangles:";
+        for (size_t triangles : stats.lodTriangles)
+            std::cerr << ' ' << triangles;
+        std::cerr << std::endl;
     }
-    output << std::endl;
 
     // Close resources
-    for (auto& file : files) {
-        if (file.is_open())
-            file.close();
+    bool written = output.flush();
+    if (outputFd != STDOUT_FILENO)
+        written = ::close(outputFd) == 0 && written;
+    if (!written) {
+        std::cerr << "Could not write output" << std::endl;
+        return -1;
     }
+    // The final flush is part of emitting
+    stats.emit += timer.lap();
+    stats.bytesWritten = output.bytesWritten();
+    if (parsedArgs.count("--stats"))
+        reportStats(stats);
     return 0;
 }
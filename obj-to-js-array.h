@@ -0,0 +1,2844 @@
+// Parsing, post-processing and output of Wavefront .obj meshes as
+// interleaved vertex and index arrays
+#ifndef OBJ_TO_JS_ARRAY_H
+#define OBJ_TO_JS_ARRAY_H
+
+#include <iostream>
+#include <string>
+#include <string_view>
+#include <vector>
+#include <utility>
+#include <unordered_map>
+#include <algorithm>
+#include <atomic>
+#include <charconv>
+#include <cstdint>
+#include <thread>
+#include <type_traits>
+#include <cmath>
+#include <limits>
+#include <cstring>
+#include <cerrno>
+#include <cstdlib>
+#include <memory>
+#include <memory_resource>
+
+#include <unistd.h>
+
+// Branch hints for the parse hot path, where malformed input is the rare case
+// (variadic, so template arguments need no extra parentheses)
+#if defined(__GNUC__)
+#define OBJTOARR_LIKELY(...) __builtin_expect(!!(__VA_ARGS__), 1)
+#define OBJTOARR_UNLIKELY(...) __builtin_expect(!!(__VA_ARGS__), 0)
+#else
+#define OBJTOARR_LIKELY(...) (__VA_ARGS__)
+#define OBJTOARR_UNLIKELY(...) (__VA_ARGS__)
+#endif
+
+// Helper types for internal data representation
+template <typename Real> struct Vec3 { Real x, y, z; };
+template <typename Real> struct Vec2 { Real x, y; };
+
+// Optional vertex attributes, stored once for the whole mesh
+enum AttributeFlags {
+    AttribNormal = 1,
+    AttribTexcoord = 2
+};
+
+// Gets the attributes kept in the vertex buffer
+inline unsigned int attributeFlags(bool disableTexture, bool disableNormal)
+{
+    return (disableNormal ? 0 : AttribNormal) | (disableTexture ? 0 : AttribTexcoord);
+}
+
+// Interleaved vertex data. Every vertex is `stride` consecutive values: the
+// position, then the normal and the texture coordinate if the mesh has them.
+template <typename Real>
+struct VertexBuffer {
+    unsigned int attribs = 0;
+    unsigned int stride = 3;
+    std::vector<Real> data;
+
+    void setAttributes(unsigned int flags)
+    {
+        attribs = flags;
+        stride = 3 + 3*hasNormals() + 2*hasTexcoords();
+    }
+    bool hasNormals() const { return attribs & AttribNormal; }
+    bool hasTexcoords() const { return attribs & AttribTexcoord; }
+    unsigned int normalOffset() const { return 3; }
+    unsigned int texcoordOffset() const { return hasNormals() ? 6 : 3; }
+
+    size_t size() const { return data.size() / stride; }
+    void resize(size_t n) { data.resize(n * stride); }
+    Real* operator[](size_t i) { return &data[i * stride]; }
+    const Real* operator[](size_t i) const { return &data[i * stride]; }
+};
+
+// Compression of an input or output stream
+enum Compression {
+    CompressionNone,
+    CompressionGzip,
+    CompressionZstd,
+};
+
+// Detects compressed data by its magic number
+inline Compression detectCompression(std::string_view data)
+{
+    if (data.size() >= 2 && data[0] == '\x1F' && data[1] == '\x8B')
+        return CompressionGzip;
+    if (data.size() >= 4 && data.substr(0, 4) == std::string_view("\x28\xB5\x2F\xFD", 4))
+        return CompressionZstd;
+    return CompressionNone;
+}
+
+// Whether this build can read and write the compression. gzip needs zlib
+// (OBJTOARR_ZLIB) and zstd needs libzstd (OBJTOARR_ZSTD).
+bool compressionSupported(Compression compression);
+
+// Read-only view over the entire input. Regular files are memory-mapped so
+// that parsing runs directly over the page cache, anything else (pipes, stdin)
+// falls back to reading into a single growing buffer.
+class InputBuffer {
+public:
+    InputBuffer() : mapped(0), mappedSize(0) {}
+    ~InputBuffer() { release(); }
+    InputBuffer(const InputBuffer&) = delete;
+    InputBuffer& operator=(const InputBuffer&) = delete;
+
+    // Opens and maps the file at the given path. Returns false on failure.
+    bool open(const char* path);
+
+    // Reads everything from the given descriptor. Returns false on failure.
+    bool read(int fd);
+
+    // Reads exactly size bytes from the descriptor, keeping the capacity of
+    // earlier reads. Returns false on failure or if the input ends first.
+    bool read(int fd, size_t size);
+
+    // Replaces gzip or zstd compressed contents with their decompressed
+    // bytes, leaving anything else as it is. Returns an error message, or 0
+    // on success.
+    const char* decompress();
+
+    std::string_view view() const
+    {
+        if (mapped)
+            return std::string_view(mapped, mappedSize);
+        return std::string_view(buffer.data(), buffer.size());
+    }
+
+private:
+    void release();
+
+    const char* mapped;
+    size_t mappedSize;
+    std::vector<char> buffer;
+};
+
+// Iterates over the lines of an in-memory buffer without copying them.
+// Line terminators (including a trailing '\r') are not part of the line.
+class LineReader {
+public:
+    explicit LineReader(std::string_view text) : rest(text), atEnd(false) {}
+
+    // Reads the next line. Returns false once the input is exhausted.
+    bool next(std::string_view& line)
+    {
+        if (rest.empty()) {
+            atEnd = true;
+            line = std::string_view();
+            return false;
+        }
+        size_t end = rest.find('\n');
+        if (end == std::string_view::npos) {
+            line = rest;
+            rest = std::string_view();
+        } else {
+            line = rest.substr(0, end);
+            rest.remove_prefix(end + 1);
+        }
+        if (!line.empty() && line.back() == '\r')
+            line.remove_suffix(1);
+        return true;
+    }
+
+    // True once a read has been attempted past the last line
+    bool eof() const { return atEnd; }
+
+private:
+    std::string_view rest;
+    bool atEnd;
+};
+
+// Skips leading whitespace and an explicit plus sign, the way formatted
+// stream extraction would accept them
+inline const char* skipNumberPrefix(const char* first, const char* last)
+{
+    while (first != last && (*first == ' ' || unsigned(*first - '\t') < 5))
+        ++first;
+    if (first != last && *first == '+')
+        ++first;
+    return first;
+}
+
+// Compresses blocks of output on a background thread and writes them to a
+// file descriptor, so compression overlaps with formatting the next block
+class StreamCompressor {
+public:
+    StreamCompressor(int fd, Compression compression);
+    ~StreamCompressor();
+    StreamCompressor(const StreamCompressor&) = delete;
+    StreamCompressor& operator=(const StreamCompressor&) = delete;
+
+    // Queues the first size bytes of the block and swaps in a free buffer
+    // of the same size. Waits while two blocks are already queued.
+    void submit(std::vector<char>& block, size_t size);
+
+    // Compresses everything queued, ends the stream and writes it out.
+    // Returns false if compressing or writing failed.
+    bool finish();
+
+private:
+    struct State;
+    std::unique_ptr<State> state;
+};
+
+// Formats output into a large contiguous buffer and writes it to a file
+// descriptor in few, large writes, optionally compressing it on the way.
+// Without a descriptor the buffer grows to hold everything, for formatting
+// parts of the output in parallel.
+class OutputBuffer {
+public:
+    explicit OutputBuffer(int fd, size_t capacity = 1 << 20)
+        : fd(fd), buffer(capacity), used(0), written(0), failed(false), inMemory(false) {}
+    OutputBuffer()
+        : fd(-1), buffer(1 << 16), used(0), written(0), failed(false), inMemory(true) {}
+    ~OutputBuffer() { flush(); }
+    OutputBuffer(const OutputBuffer&) = delete;
+    OutputBuffer& operator=(const OutputBuffer&) = delete;
+
+    void put(char c)
+    {
+        reserve(1);
+        buffer[used++] = c;
+    }
+
+    void write(std::string_view s)
+    {
+        // An empty view may have no data to copy from
+        if (s.empty())
+            return;
+        if (inMemory) {
+            reserve(s.size());
+        } else if (s.size() > buffer.size() - used) {
+            drain();
+            if (s.size() > buffer.size()) {
+                writeAll(s.data(), s.size());
+                return;
+            }
+        }
+        std::memcpy(&buffer[used], s.data(), s.size());
+        used += s.size();
+    }
+
+    // Writes the value with the given number of significant digits like
+    // printf's %g, or as the shortest round-trip form if precision < 0
+    template <typename Real>
+    void writeNumber(Real value, int precision)
+    {
+        reserve(precision + 32);
+        char* first = &buffer[used];
+        char* last = buffer.data() + buffer.size();
+        std::to_chars_result r = precision < 0
+            ? std::to_chars(first, last, value)
+            : std::to_chars(first, last, value, std::chars_format::general, precision);
+        used = r.ptr - buffer.data();
+    }
+
+    void writeNumber(unsigned int value)
+    {
+        reserve(16);
+        char* first = &buffer[used];
+        used = std::to_chars(first, buffer.data() + buffer.size(), value).ptr - buffer.data();
+    }
+
+    // For counts that can pass 2^32, such as indices over many runs
+    void writeNumber(uint64_t value)
+    {
+        reserve(24);
+        char* first = &buffer[used];
+        used = std::to_chars(first, buffer.data() + buffer.size(), value).ptr - buffer.data();
+    }
+
+    // Flushes what is buffered and continues on another descriptor, keeping
+    // the buffer. The byte count and error state restart from zero, and
+    // output is no longer compressed.
+    void reopen(int newFd);
+
+    // Compresses everything written from now on, or stops compressing
+    void compress(Compression compression);
+
+    // Total number of bytes output so far before compression, including
+    // those still buffered
+    size_t bytesWritten() const { return written + used; }
+
+    // What an in-memory buffer holds, and emptying it for reuse
+    std::string_view view() const { return std::string_view(buffer.data(), used); }
+    void clear() { used = 0; }
+
+    // Writes out everything buffered so far, ending the compressed stream if
+    // any. Returns false if any write failed.
+    bool flush();
+
+private:
+    void reserve(size_t n)
+    {
+        if (inMemory && n > buffer.size() - used) {
+            buffer.resize(std::max(2 * buffer.size(), used + n));
+        } else if (n > buffer.size() - used) {
+            drain();
+            if (n > buffer.size())
+                buffer.resize(n);
+        }
+    }
+
+    // Hands the buffered bytes on to be written
+    void drain();
+
+    void writeAll(const char* data, size_t size);
+
+    int fd;
+    std::vector<char> buffer;
+    size_t used;
+    size_t written;
+    bool failed;
+    bool inMemory;
+    std::unique_ptr<StreamCompressor> compressor;
+};
+
+// Append-only index array that spills to an unlinked temporary file, so only
+// a bounded block of indices is ever held in memory. The default block size
+// is a multiple of 3, so blocks of triangle indices hold whole triangles.
+class IndexSpill {
+public:
+    explicit IndexSpill(size_t blockSize = 3 << 16)
+        : fd(-1), blockSize(blockSize), spilled(0), failed(false) { block.reserve(blockSize); }
+    ~IndexSpill();
+    IndexSpill(const IndexSpill&) = delete;
+    IndexSpill& operator=(const IndexSpill&) = delete;
+
+    // Creates the temporary file in $TMPDIR or /tmp. Returns false on failure.
+    bool open();
+
+    void push_back(unsigned int index)
+    {
+        block.push_back(index);
+        if (block.size() == blockSize)
+            spill();
+    }
+
+    size_t size() const { return spilled + block.size(); }
+
+    // True if spilling to the file has failed
+    bool bad() const { return failed; }
+
+    // Calls fn(unsigned int* indices, size_t count) for consecutive blocks in
+    // order. The blocks may be modified. Returns false if reading failed.
+    template <typename F>
+    bool forEachBlock(F fn)
+    {
+        std::vector<unsigned int> buffer(blockSize);
+        for (size_t offset = 0; offset < spilled && !failed;) {
+            size_t count = std::min(blockSize, spilled - offset);
+            failed = pread(fd, buffer.data(), count * sizeof(unsigned int),
+                           offset * sizeof(unsigned int)) != ssize_t(count * sizeof(unsigned int));
+            if (!failed)
+                fn(buffer.data(), count);
+            offset += count;
+        }
+        if (!failed && !block.empty())
+            fn(block.data(), block.size());
+        return !failed;
+    }
+
+private:
+    void spill();
+
+    int fd;
+    size_t blockSize;
+    size_t spilled; // Number of indices in the file
+    std::vector<unsigned int> block;
+    bool failed;
+};
+
+// Converts a single non-empty token to T. Returns false if it is not a T.
+// Like stream extraction, only a prefix of the token needs to be numeric.
+template <typename Real>
+inline bool parseReal(std::string_view item, Real& out)
+{
+    const char* last = item.data() + item.size();
+    const char* first = skipNumberPrefix(item.data(), last);
+    return std::from_chars(first, last, out).ec == std::errc();
+}
+
+inline bool parseToken(std::string_view item, double& out) { return parseReal(item, out); }
+inline bool parseToken(std::string_view item, float& out) { return parseReal(item, out); }
+
+inline bool parseToken(std::string_view item, std::string_view& out)
+{
+    out = item;
+    return true;
+}
+
+// Parses a face vertex of the form v, v/vt, v//vn or v/vt/vn into up to
+// three indices in a single pass. Blank components get the sentinel 0, and
+// negative (relative) indices are stored as their two's complement.
+// Returns the number of components, or -1 if one is not an index.
+inline int parseFaceVertex(unsigned int out[3], std::string_view v)
+{
+    const char* p = v.data();
+    const char* last = p + v.size();
+    out[0] = out[1] = out[2] = 0;
+
+    int count = 0;
+    while (p != last && count < 3) {
+        if (*p == '/') {
+            // Blank component keeps the sentinel
+            ++p; ++count;
+            continue;
+        }
+        const char* digits = skipNumberPrefix(p, last);
+        bool negative = digits != last && *digits == '-';
+        digits += negative;
+        unsigned long long value = 0;
+        for (p = digits; p != last && unsigned(*p - '0') < 10; ++p) {
+            value = value * 10 + unsigned(*p - '0');
+            if (OBJTOARR_UNLIKELY(value > 0x7FFFFFFFull))
+                return -1;
+        }
+        if (OBJTOARR_UNLIKELY(p == digits))
+            return -1;
+        out[count++] = static_cast<unsigned int>(negative ? 0 - value : value);
+        // Ignore anything trailing the digits in this component
+        while (p != last && *p++ != '/') {}
+    }
+    return count;
+}
+
+// Tokenize the given line into tokens. Returns the number of tokens parsed,
+// or -1 if there was an invalid parsing of string to T.
+template <typename T>
+int tokenize(T out[], std::string_view line, // The line to tokenize
+             int maxTokens = 3,          // Max number of tokens parsed
+             bool skipFirst = true,      // Skip the first token if true
+             char delim = ' ',           // Delimiter that separates tokens
+             const T& sentinel = T())    // Sentinel placed for empty lines
+{
+    // Splits off the next token, mirroring std::getline semantics
+    auto nextItem = [&line, delim](std::string_view& item) {
+        if (line.empty())
+            return false;
+        size_t end = line.find(delim);
+        item = line.substr(0, end);
+        line.remove_prefix(end == std::string_view::npos ? line.size() : end + 1);
+        return true;
+    };
+    std::string_view item;
+
+    // Skip the first token in the line if specified
+    if (skipFirst)
+        nextItem(item);
+
+    // Count up to the max tokens, or until no more tokens
+    int count = 0;
+    for (; count < maxTokens && nextItem(item); ++count) {
+        if (item.length() == 0) {
+            // Put sentinel for a blank token
+            out[count] = sentinel;
+        } else if (!parseToken(item, out[count])) {
+            // Could not convert to T
+            return -1;
+        }
+    }
+    return count;
+}
+
+// Parses a single vertex attribute line of dimension D.
+// Returns false if the line is malformed.
+template <typename V, unsigned int D>
+bool parseAttribute(std::string_view line, V& v)
+{
+    typedef decltype(v.x) Real;
+    // Only the first D values are kept, so "vt u v w" keeps u and v
+    Real values[D] = {};
+    if (tokenize(values, line, D) <= 0)
+        return false;
+    Real* vptr = &v.x;
+    for (unsigned int i = 0; i < D; ++i)
+        *(vptr + i) = values[i];
+    return true;
+}
+
+// Category of a line in a .obj file, as seen by the record dispatcher
+enum RecordKind {
+    RecordSkip,     // Blank lines and comments
+    RecordPosition, // v
+    RecordTexcoord, // vt
+    RecordNormal,   // vn
+    RecordFace,     // f
+    RecordOther     // Anything else
+};
+
+inline RecordKind classifyRecord(std::string_view line)
+{
+    if (line.length() < 2 || line[0] == '#')
+        return RecordSkip;
+    if (line[0] == 'v') {
+        switch (line[1]) {
+        case ' ': return RecordPosition;
+        case 't': return RecordTexcoord;
+        case 'n': return RecordNormal;
+        }
+    }
+    return line[0] == 'f' ? RecordFace : RecordOther;
+}
+
+// Counters collected while parsing
+struct ParseStats {
+    size_t records[RecordOther + 1] = {}; // Lines read by RecordKind
+    size_t tableEntries = 0;              // Entries in the vertex dedup tables
+    size_t tableSlots = 0;                // Slots in the vertex dedup tables
+};
+
+// Runs fn(t) for every t in [0, threads), each on its own thread
+template <typename F>
+void runParallel(unsigned int threads, F fn)
+{
+    std::vector<std::thread> workers;
+    for (unsigned int t = 1; t < threads; ++t)
+        workers.emplace_back(fn, t);
+    if (threads > 0)
+        fn(0u);
+    for (auto& worker : workers)
+        worker.join();
+}
+
+// Gets the t-th of n evenly split ranges over [0, size)
+inline std::pair<size_t, size_t> splitRange(size_t size, unsigned int t, unsigned int n)
+{
+    return std::make_pair(size * t / n, size * (t + 1) / n);
+}
+
+// Vertex attributes referenced by the faces
+template <typename Real>
+struct Attributes {
+    explicit Attributes(std::pmr::memory_resource* resource = std::pmr::get_default_resource())
+        : positions(resource), texcoords(resource), normals(resource) {}
+
+    std::pmr::vector<Vec3<Real>> positions;
+    std::pmr::vector<Vec2<Real>> texcoords;
+    std::pmr::vector<Vec3<Real>> normals;
+};
+
+// A face vertex by its position, texture coordinate and normal indices.
+// Indices are 1-based, with 0 for an attribute that is not referenced.
+struct VertexKey {
+    unsigned int v, vt, vn;
+    bool operator==(const VertexKey& o) const { return v == o.v && vt == o.vt && vn == o.vn; }
+};
+
+inline uint64_t hashKey(const VertexKey& key)
+{
+    uint64_t h = key.v * 0x9E3779B97F4A7C15ull ^ key.vt * 0xC2B2AE3D27D4EB4Full
+               ^ key.vn * 0x165667B19E3779F9ull;
+    h ^= h >> 32;
+    h *= 0xD6E8FEB86659FD93ull;
+    return h ^ (h >> 32);
+}
+
+// Parses a face vertex into its key. Returns false if it is malformed.
+inline bool parseVertexKey(std::string_view v, VertexKey& key)
+{
+    unsigned int locations[3];
+    if (parseFaceVertex(locations, v) <= 0)
+        return false;
+    key = {locations[0], locations[1], locations[2]};
+    return true;
+}
+
+// Resolves a parsed face index against the number of attributes defined so
+// far, where -1 is the last one. Returns false if there is no such attribute.
+inline bool resolveIndex(unsigned int& index, size_t count)
+{
+    int64_t value = int32_t(index);
+    if (value == 0)
+        return true;
+    if (value < 0)
+        value += int64_t(count) + 1;
+    if (value < 1 || value > int64_t(count))
+        return false;
+    index = static_cast<unsigned int>(value);
+    return true;
+}
+
+// Resolves the indices of a parsed face vertex against the numbers of
+// positions, texture coordinates and normals defined so far. Attributes the
+// layout leaves out are dropped from the key, so corners that only differ in
+// them become one vertex. Returns false if the vertex refers to a missing
+// attribute.
+inline bool resolveVertexKey(VertexKey& key, const size_t counts[3], unsigned int attribs)
+{
+    if (!(attribs & AttribTexcoord))
+        key.vt = 0;
+    if (!(attribs & AttribNormal))
+        key.vn = 0;
+    return key.v != 0 && resolveIndex(key.v, counts[0]) && resolveIndex(key.vt, counts[1])
+        && resolveIndex(key.vn, counts[2]);
+}
+
+// Resolves a run of parsed face vertices like resolveVertexKey. Whether all
+// indices are absolute and in range is checked without branching over the
+// run, so only runs with relative or missing indices go vertex by vertex.
+// Returns the position of the first bad vertex, left as parsed, or count if
+// all are good.
+inline size_t resolveVertexKeys(VertexKey* keys, size_t count, const size_t counts[3], unsigned int attribs)
+{
+    unsigned int vtMask = attribs & AttribTexcoord ? ~0u : 0, vnMask = attribs & AttribNormal ? ~0u : 0;
+    bool absolute = true;
+    for (size_t i = 0; i < count; ++i) {
+        const VertexKey& key = keys[i];
+        absolute &= (key.v - 1u < counts[0]) & ((key.vt & vtMask) <= counts[1]) & ((key.vn & vnMask) <= counts[2]);
+    }
+    if (OBJTOARR_LIKELY(absolute)) {
+        if (vtMask & vnMask)
+            return count;
+        for (size_t i = 0; i < count; ++i) {
+            keys[i].vt &= vtMask;
+            keys[i].vn &= vnMask;
+        }
+        return count;
+    }
+    for (size_t i = 0; i < count; ++i) {
+        VertexKey parsed = keys[i];
+        if (!resolveVertexKey(keys[i], counts, attribs)) {
+            keys[i] = parsed;
+            return i;
+        }
+    }
+    return count;
+}
+
+// Formats a parsed face vertex the way it is written in a face
+inline std::string formatVertexKey(const VertexKey& key)
+{
+    std::string text = std::to_string(int32_t(key.v));
+    if (key.vt || key.vn)
+        text += '/' + (key.vt ? std::to_string(int32_t(key.vt)) : std::string());
+    if (key.vn)
+        text += '/' + std::to_string(int32_t(key.vn));
+    return text;
+}
+
+// Scratch space for triangulating faces. Each thread keeps one and reuses
+// it from face to face, so only a face larger than all before it allocates.
+struct FaceScratch {
+    explicit FaceScratch(std::pmr::memory_resource* resource = std::pmr::get_default_resource())
+        : vertices(resource), keys(resource), polygon(resource), projected(resource) {}
+
+    std::pmr::vector<std::string_view> vertices; // Face vertex tokens
+    std::pmr::vector<VertexKey> keys;            // Parsed face vertices
+    std::pmr::vector<unsigned int> polygon;      // Corners not yet clipped off
+    std::pmr::vector<double> projected;          // Corner positions in the face plane
+};
+
+// A face with more than four vertices, stored as a fan of triangles that
+// starts at the given corner until the positions are known
+struct FaceRef {
+    size_t offset;
+    unsigned int degree;
+};
+
+// Splits a face line into its vertex tokens, ignoring trailing blanks.
+// Returns the number of vertices.
+inline size_t splitFace(std::string_view line, std::pmr::vector<std::string_view>& vertices)
+{
+    vertices.clear();
+    line.remove_prefix(std::min(line.size(), line.find(' ')));
+    while (!line.empty() && line.back() == ' ')
+        line.remove_suffix(1);
+    while (!line.empty()) {
+        // Same splitting as tokenize: every single space separates tokens
+        line.remove_prefix(1);
+        size_t end = line.find(' ');
+        vertices.push_back(line.substr(0, end));
+        line.remove_prefix(end == std::string_view::npos ? line.size() : end);
+    }
+    return vertices.size();
+}
+
+// Parses the vertices of a face line into scratch.keys. Returns null on
+// success, otherwise an error message to which detail is appended.
+inline const char* parseFace(std::string_view line, FaceScratch& scratch, std::string_view& detail)
+{
+    size_t degree = splitFace(line, scratch.vertices);
+    if (degree < 3) {
+        detail = line;
+        return "Faces must have at least 3 vertices: ";
+    }
+    scratch.keys.resize(degree);
+    for (size_t i = 0; i < degree; ++i) {
+        if (OBJTOARR_UNLIKELY(!parseVertexKey(scratch.vertices[i], scratch.keys[i]))) {
+            detail = scratch.vertices[i];
+            return "Malformed vertex ";
+        }
+    }
+    return 0;
+}
+
+// Triangulates a face of n vertices, calling emit(a, b, c) with the corner
+// numbers of every triangle in order. Triangles and quads, as well as convex
+// larger faces, become a fan around the first corner. Concave faces of five
+// or more vertices are ear clipped in their plane. Faces without area or with
+// missing positions fall back to the fan.
+template <typename Real, typename F>
+void triangulateFace(const std::pmr::vector<Vec3<Real>>& positions, const VertexKey* keys,
+                     unsigned int n, FaceScratch& scratch, F emit)
+{
+    auto fan = [&]() {
+        for (unsigned int k = 1; k + 1 < n; ++k)
+            emit(0u, k, k + 1);
+    };
+    // Quads keep their split along the first diagonal, which for the usual
+    // non-planar quad is as good as any other
+    if (n <= 4)
+        return fan();
+    for (unsigned int i = 0; i < n; ++i) {
+        if (keys[i].v == 0 || keys[i].v > positions.size())
+            return fan();
+    }
+
+    // Newell's method gives the face normal even for concave faces
+    double normal[3] = {0, 0, 0};
+    for (unsigned int i = 0; i < n; ++i) {
+        const Vec3<Real>& a = positions[keys[i].v - 1];
+        const Vec3<Real>& b = positions[keys[(i + 1) % n].v - 1];
+        normal[0] += (double(a.y) - b.y) * (double(a.z) + b.z);
+        normal[1] += (double(a.z) - b.z) * (double(a.x) + b.x);
+        normal[2] += (double(a.x) - b.x) * (double(a.y) + b.y);
+    }
+    // Project along the dominant axis, mirrored so the face winds counterclockwise
+    int axis = std::fabs(normal[0]) > std::fabs(normal[1]) ? 0 : 1;
+    axis = std::fabs(normal[2]) >= std::fabs(normal[axis]) ? 2 : axis;
+    if (normal[axis] == 0)
+        return fan();
+    double mirror = normal[axis] > 0 ? 1 : -1;
+    std::pmr::vector<double>& p = scratch.projected;
+    p.resize(2 * n);
+    for (unsigned int i = 0; i < n; ++i) {
+        const Real* v = &positions[keys[i].v - 1].x;
+        p[2*i] = mirror * v[(axis + 1) % 3];
+        p[2*i + 1] = v[(axis + 2) % 3];
+    }
+    auto orient = [&p](unsigned int a, unsigned int b, unsigned int c) {
+        return (p[2*b] - p[2*a]) * (p[2*c + 1] - p[2*a + 1]) - (p[2*b + 1] - p[2*a + 1]) * (p[2*c] - p[2*a]);
+    };
+
+    bool convex = true;
+    for (unsigned int i = 0; i < n && convex; ++i)
+        convex = orient((i + n - 1) % n, i, (i + 1) % n) >= 0;
+    if (convex)
+        return fan();
+
+    // Clip off ears, corners whose triangle contains no other corner
+    std::pmr::vector<unsigned int>& polygon = scratch.polygon;
+    polygon.resize(n);
+    for (unsigned int i = 0; i < n; ++i)
+        polygon[i] = i;
+    for (size_t m = n; m > 3;) {
+        bool clipped = false;
+        for (size_t j = 0; j < m && !clipped; ++j) {
+            unsigned int a = polygon[(j + m - 1) % m], b = polygon[j], c = polygon[(j + 1) % m];
+            if (orient(a, b, c) <= 0)
+                continue;
+            bool ear = true;
+            for (size_t k = 0; k < m && ear; ++k) {
+                unsigned int q = polygon[k];
+                bool corner = (p[2*q] == p[2*a] && p[2*q + 1] == p[2*a + 1])
+                           || (p[2*q] == p[2*b] && p[2*q + 1] == p[2*b + 1])
+                           || (p[2*q] == p[2*c] && p[2*q + 1] == p[2*c + 1]);
+                ear = corner || orient(a, b, q) < 0 || orient(b, c, q) < 0 || orient(c, a, q) < 0;
+            }
+            if (ear) {
+                emit(a, b, c);
+                polygon.erase(polygon.begin() + j);
+                --m;
+                clipped = true;
+            }
+        }
+        // Self-intersecting faces can run out of ears, fan what is left
+        if (!clipped) {
+            for (size_t k = 1; k + 1 < m; ++k)
+                emit(polygon[0], polygon[k], polygon[k + 1]);
+            return;
+        }
+    }
+    emit(polygon[0], polygon[1], polygon[2]);
+}
+
+// Open-addressing (linear probing) map from face vertex keys to indices
+class VertexTable {
+public:
+    explicit VertexTable(std::pmr::memory_resource* resource = std::pmr::get_default_resource())
+        : slots(resource), count(0) {}
+
+    // Looks up the key, inserting it with the given index if it is missing.
+    // Returns the index stored for the key.
+    unsigned int insert(const VertexKey& key, unsigned int index)
+    {
+        if ((count + 1) * 2 > slots.size())
+            grow();
+        size_t mask = slots.size() - 1;
+        for (size_t i = hashKey(key) & mask;; i = (i + 1) & mask) {
+            Slot& slot = slots[i];
+            if (slot.index == Empty) {
+                slot.key = key;
+                slot.index = index;
+                ++count;
+                return index;
+            }
+            if (slot.key == key)
+                return slot.index;
+        }
+    }
+
+    void reserve(size_t n)
+    {
+        size_t capacity = 16;
+        while (capacity < n * 2)
+            capacity *= 2;
+        if (capacity > slots.size())
+            rehash(capacity);
+    }
+
+    // Removes all entries, keeping the allocated slots
+    void clear()
+    {
+        if (count)
+            std::fill(slots.begin(), slots.end(), Slot());
+        count = 0;
+    }
+
+    size_t size() const { return count; }
+    size_t capacity() const { return slots.size(); }
+
+    // Calls fn(key, index) for every entry, in no particular order
+    template <typename F>
+    void forEach(F fn) const
+    {
+        for (const Slot& slot : slots) {
+            if (slot.index != Empty)
+                fn(slot.key, slot.index);
+        }
+    }
+
+private:
+    static const unsigned int Empty = ~0u;
+    struct Slot {
+        VertexKey key;
+        unsigned int index = Empty;
+    };
+
+    void grow() { rehash(slots.empty() ? 16 : slots.size() * 2); }
+
+    void rehash(size_t capacity)
+    {
+        std::pmr::vector<Slot> old(capacity, slots.get_allocator());
+        old.swap(slots);
+        size_t mask = capacity - 1;
+        for (const Slot& slot : old) {
+            if (slot.index == Empty)
+                continue;
+            size_t i = hashKey(slot.key) & mask;
+            while (slots[i].index != Empty)
+                i = (i + 1) & mask;
+            slots[i] = slot;
+        }
+    }
+
+    std::pmr::vector<Slot> slots;
+    size_t count;
+};
+
+// Buffers and settings for parsing meshes. The buffers are allocated from
+// the memory resource given at construction, and reusing one context for
+// consecutive meshes keeps their capacity between calls. Only the calling
+// thread allocates from the resource, so it need not be synchronized;
+// scratch memory of the worker threads comes from the default resource.
+template <typename Real>
+struct ParseContext {
+    explicit ParseContext(std::pmr::memory_resource* resource = std::pmr::get_default_resource())
+        : attribs(resource), table(resource), corners(resource), faces(resource), scratch(resource) {}
+
+    std::ostream* log = &std::cerr;      // Where parse errors are reported
+    ParseStats stats;                    // Counters of the last parse
+    Attributes<Real> attribs;
+    VertexTable table;                   // Vertex dedup table
+    std::pmr::vector<VertexKey> corners; // Face vertices for the parallel parser
+    std::pmr::vector<FaceRef> faces;     // Faces to triangulate for the parallel parser
+    FaceScratch scratch;                 // Face scratch space of the calling thread
+    // Vertices numbered by earlier parses of the same mesh. New vertices of
+    // objToJsSequential are numbered after them, for parsing a growing file
+    // in parts with the attributes and dedup table kept in between.
+    unsigned int vertexBase = 0;
+
+    std::pmr::memory_resource* resource() const { return corners.get_allocator().resource(); }
+
+    // Empties the buffers for the next mesh, keeping their capacity
+    void clear()
+    {
+        stats = ParseStats();
+        attribs.positions.clear();
+        attribs.texcoords.clear();
+        attribs.normals.clear();
+        table.clear();
+        corners.clear();
+        faces.clear();
+        vertexBase = 0;
+    }
+
+    // Returns all buffers to the memory resource, for example before
+    // releasing the arena they were allocated from
+    void release()
+    {
+        stats = ParseStats();
+        attribs = Attributes<Real>(resource());
+        table = VertexTable(resource());
+        std::pmr::vector<VertexKey>(resource()).swap(corners);
+        std::pmr::vector<FaceRef>(resource()).swap(faces);
+        scratch = FaceScratch(resource());
+        vertexBase = 0;
+    }
+};
+
+// Writes the attributes of the vertex referenced by the key, in the layout
+// of the vertex buffer. Unreferenced attributes are zero.
+template <typename Real>
+inline void makeVertex(const Attributes<Real>& attribs, const VertexKey& key,
+                       const VertexBuffer<Real>& layout, Real* out)
+{
+    const Vec3<Real>& pos = attribs.positions[key.v - 1];
+    out[0] = pos.x; out[1] = pos.y; out[2] = pos.z;
+    if (layout.hasNormals()) {
+        Vec3<Real> norm = {0, 0, 0};
+        if (key.vn > 0)
+            norm = attribs.normals[key.vn - 1];
+        Real* n = out + layout.normalOffset();
+        n[0] = norm.x; n[1] = norm.y; n[2] = norm.z;
+    }
+    if (layout.hasTexcoords()) {
+        Vec2<Real> tex = {0, 0};
+        if (key.vt > 0)
+            tex = attribs.texcoords[key.vt - 1];
+        Real* t = out + layout.texcoordOffset();
+        t[0] = tex.x; t[1] = tex.y;
+    }
+}
+
+// Deduplicates face vertices into the vertex and element buffers. Indices
+// can be any append-only sequence with push_back.
+template <typename Real, typename Indices = std::vector<unsigned int>>
+class VertexCache {
+public:
+    // New vertices are numbered from base on, the vertex data only holds them
+    VertexCache(const Attributes<Real>& attribs, VertexTable& indexCache,
+                VertexBuffer<Real>& vertexData, Indices& elementData, unsigned int base = 0)
+        : attribs(attribs), indexCache(indexCache), vertexData(vertexData), elementData(elementData),
+          base(base) {}
+
+    // Appends the index of the given face vertex, creating the vertex if it
+    // has not been seen yet
+    void add(const VertexKey& key)
+    {
+        size_t count = base + vertexData.size();
+        unsigned int index = indexCache.insert(key, count);
+        if (index == count) {
+            vertexData.resize(count - base + 1);
+            makeVertex(attribs, key, vertexData, vertexData[count - base]);
+        }
+        elementData.push_back(index);
+    }
+
+private:
+    const Attributes<Real>& attribs;
+    VertexTable& indexCache;
+    VertexBuffer<Real>& vertexData;
+    Indices& elementData;
+    unsigned int base;
+};
+
+// Deduplicates face vertices on multiple threads. The keys are sharded by
+// hash so every shard is deduplicated independently, then vertices are
+// numbered by their first occurrence, exactly as VertexCache would.
+template <typename Real>
+void dedupVertices(const Attributes<Real>& attribs, const std::pmr::vector<VertexKey>& corners,
+                   VertexBuffer<Real>& vertexData, std::vector<unsigned int>& elementData,
+                   unsigned int threads, ParseStats& stats)
+{
+    size_t N = corners.size();
+    unsigned int shards = threads;
+    auto shardOf = [shards](const VertexKey& key) {
+        return static_cast<unsigned int>((hashKey(key) >> 40) % shards);
+    };
+
+    // Scatter corner indices into shards, keeping file order within a shard
+    std::vector<size_t> offsets(threads * shards + 1, 0);
+    runParallel(threads, [&](unsigned int t) {
+        auto range = splitRange(N, t, threads);
+        for (size_t c = range.first; c < range.second; ++c)
+            ++offsets[shardOf(corners[c]) * threads + t + 1];
+    });
+    for (size_t i = 1; i < offsets.size(); ++i)
+        offsets[i] += offsets[i - 1];
+    std::vector<unsigned int> order(N);
+    runParallel(threads, [&](unsigned int t) {
+        auto range = splitRange(N, t, threads);
+        std::vector<size_t> next(shards);
+        for (unsigned int s = 0; s < shards; ++s)
+            next[s] = offsets[s * threads + t];
+        for (size_t c = range.first; c < range.second; ++c)
+            order[next[shardOf(corners[c])]++] = c;
+    });
+
+    // Find the first corner that refers to each unique vertex
+    std::vector<unsigned int> firstCorner(N);
+    std::vector<size_t> tableEntries(shards), tableSlots(shards);
+    runParallel(shards, [&](unsigned int s) {
+        size_t begin = offsets[s * threads], end = offsets[(s + 1) * threads];
+        VertexTable table;
+        table.reserve((end - begin) / 2);
+        for (size_t i = begin; i < end; ++i) {
+            unsigned int c = order[i];
+            firstCorner[c] = table.insert(corners[c], c);
+        }
+        tableEntries[s] = table.size();
+        tableSlots[s] = table.capacity();
+    });
+    for (unsigned int s = 0; s < shards; ++s) {
+        stats.tableEntries += tableEntries[s];
+        stats.tableSlots += tableSlots[s];
+    }
+    std::vector<unsigned int>().swap(order);
+
+    // Number the vertices by first occurrence
+    std::vector<size_t> counts(threads + 1, 0);
+    runParallel(threads, [&](unsigned int t) {
+        auto range = splitRange(N, t, threads);
+        for (size_t c = range.first; c < range.second; ++c)
+            counts[t + 1] += firstCorner[c] == c;
+    });
+    for (unsigned int t = 0; t < threads; ++t)
+        counts[t + 1] += counts[t];
+
+    size_t base = elementData.size(), vertexBase = vertexData.size();
+    elementData.resize(base + N);
+    vertexData.resize(vertexBase + counts[threads]);
+    runParallel(threads, [&](unsigned int t) {
+        auto range = splitRange(N, t, threads);
+        unsigned int next = vertexBase + counts[t];
+        for (size_t c = range.first; c < range.second; ++c) {
+            if (firstCorner[c] == c) {
+                makeVertex(attribs, corners[c], vertexData, vertexData[next]);
+                elementData[base + c] = next++;
+            }
+        }
+    });
+    // First corners were set above and are only read from here on, so other
+    // threads can look them up without racing on them
+    runParallel(threads, [&](unsigned int t) {
+        auto range = splitRange(N, t, threads);
+        for (size_t c = range.first; c < range.second; ++c) {
+            if (firstCorner[c] != c)
+                elementData[base + c] = elementData[base + firstCorner[c]];
+        }
+    });
+}
+
+// Reads a .obj file and parses the vertex positions, texture coordinates,
+// normals, and triangulated faces on a single thread. Records may come in
+// any order, faces can reference every attribute defined before them.
+// Returns true on success, otherwise false.
+template <typename Real, typename Indices>
+bool objToJsSequential(std::string_view text, VertexBuffer<Real>& vertexData, Indices& elementData,
+                       ParseContext<Real>& context)
+{
+    LineReader in(text);
+    std::string_view line, detail;
+    Attributes<Real>& attribs = context.attribs;
+    ParseStats& stats = context.stats;
+    std::ostream& log = *context.log;
+
+    FaceScratch& scratch = context.scratch;
+    VertexCache<Real, Indices> cache(attribs, context.table, vertexData, elementData, context.vertexBase);
+    auto addTriangle = [&](unsigned int a, unsigned int b, unsigned int c) {
+        cache.add(scratch.keys[a]);
+        cache.add(scratch.keys[b]);
+        cache.add(scratch.keys[c]);
+    };
+
+    while (in.next(line)) {
+        RecordKind kind = classifyRecord(line);
+        ++stats.records[kind];
+        switch (kind) {
+        case RecordPosition: {
+            Vec3<Real> v;
+            if (OBJTOARR_UNLIKELY(!parseAttribute<Vec3<Real>,3>(line, v))) {
+                log << "Malformed vertex position: " << line << std::endl;
+                return false;
+            }
+            attribs.positions.push_back(v);
+            break;
+        }
+        case RecordTexcoord: {
+            // Attributes the layout leaves out are not even parsed
+            if (!vertexData.hasTexcoords())
+                break;
+            Vec2<Real> v;
+            if (OBJTOARR_UNLIKELY(!parseAttribute<Vec2<Real>,2>(line, v))) {
+                log << "Malformed texture coordinates: " << line << std::endl;
+                return false;
+            }
+            attribs.texcoords.push_back(v);
+            break;
+        }
+        case RecordNormal: {
+            if (!vertexData.hasNormals())
+                break;
+            Vec3<Real> v;
+            if (OBJTOARR_UNLIKELY(!parseAttribute<Vec3<Real>,3>(line, v))) {
+                log << "Malformed vertex normals: " << line << std::endl;
+                return false;
+            }
+            attribs.normals.push_back(v);
+            break;
+        }
+        case RecordFace: {
+            if (const char* error = parseFace(line, scratch, detail); OBJTOARR_UNLIKELY(error)) {
+                log << error << detail << std::endl;
+                return false;
+            }
+            const size_t counts[3] = {attribs.positions.size(), attribs.texcoords.size(),
+                                      attribs.normals.size()};
+            size_t bad = resolveVertexKeys(scratch.keys.data(), scratch.keys.size(), counts, vertexData.attribs);
+            if (OBJTOARR_UNLIKELY(bad != scratch.keys.size())) {
+                log << "Vertex index out of range: " << formatVertexKey(scratch.keys[bad]) << std::endl;
+                return false;
+            }
+            triangulateFace(attribs.positions, scratch.keys.data(), scratch.keys.size(), scratch,
+                            addTriangle);
+            break;
+        }
+        default: // Comments, objects, groups, materials and the like
+            break;
+        }
+    }
+    if (attribs.positions.empty()) {
+        log << "Could not parse any vertex positions" << std::endl;
+        return false;
+    }
+
+    stats.tableEntries += context.table.size();
+    stats.tableSlots += context.table.capacity();
+    return true;
+}
+
+// Faces parsed while the chunk had the given numbers of positions, texture
+// coordinates and normals. Their corners end at the given offset.
+struct FaceBlock {
+    size_t end;
+    size_t counts[3];
+};
+
+// Records parsed from one newline-aligned chunk of the input. Face indices
+// are left unresolved until the attribute counts of earlier chunks are known.
+template <typename Real>
+struct ChunkRecords {
+    Attributes<Real> attribs;
+    std::vector<VertexKey> corners; // Triangulated face vertices as parsed
+    std::vector<FaceRef> faces;     // Faces in corners still to triangulate
+    std::vector<FaceBlock> blocks;  // Attribute counts for runs of corners
+    const char* error = 0;          // Message for the first malformed record, if any
+    std::string_view detail;        // Offending text appended to the error
+    size_t records[RecordOther + 1] = {};
+};
+
+// Parses every record in the chunk, stopping at the first malformed one.
+// Attributes that are not in the layout are skipped.
+template <typename Real>
+void parseChunk(std::string_view text, unsigned int layout, ChunkRecords<Real>& out)
+{
+    LineReader in(text);
+    std::string_view line;
+    FaceScratch scratch;
+
+    auto fail = [&out](const char* error, std::string_view detail) {
+        out.error = error;
+        out.detail = detail;
+    };
+
+    while (!out.error && in.next(line)) {
+        RecordKind kind = classifyRecord(line);
+        ++out.records[kind];
+        switch (kind) {
+        case RecordPosition: {
+            Vec3<Real> v;
+            if (OBJTOARR_LIKELY(parseAttribute<Vec3<Real>,3>(line, v)))
+                out.attribs.positions.push_back(v);
+            else
+                fail("Malformed vertex position: ", line);
+            break;
+        }
+        case RecordTexcoord: {
+            if (!(layout & AttribTexcoord))
+                break;
+            Vec2<Real> v;
+            if (OBJTOARR_LIKELY(parseAttribute<Vec2<Real>,2>(line, v)))
+                out.attribs.texcoords.push_back(v);
+            else
+                fail("Malformed texture coordinates: ", line);
+            break;
+        }
+        case RecordNormal: {
+            if (!(layout & AttribNormal))
+                break;
+            Vec3<Real> v;
+            if (OBJTOARR_LIKELY(parseAttribute<Vec3<Real>,3>(line, v)))
+                out.attribs.normals.push_back(v);
+            else
+                fail("Malformed vertex normals: ", line);
+            break;
+        }
+        case RecordFace: {
+            if (const char* error = parseFace(line, scratch, out.detail); OBJTOARR_UNLIKELY(error)) {
+                fail(error, out.detail);
+                break;
+            }
+            // Start a new block if attributes were added since the last face
+            const size_t counts[3] = {out.attribs.positions.size(), out.attribs.texcoords.size(),
+                                      out.attribs.normals.size()};
+            if (out.blocks.empty() || !std::equal(counts, counts + 3, out.blocks.back().counts))
+                out.blocks.push_back({out.corners.size(), {counts[0], counts[1], counts[2]}});
+            // Positions may still be in other chunks, so keep larger faces
+            // as a fan and triangulate them properly after the merge
+            unsigned int degree = scratch.keys.size();
+            if (degree > 4)
+                out.faces.push_back({out.corners.size(), degree});
+            for (unsigned int k = 1; k + 1 < degree; ++k) {
+                out.corners.push_back(scratch.keys[0]);
+                out.corners.push_back(scratch.keys[k]);
+                out.corners.push_back(scratch.keys[k + 1]);
+            }
+            out.blocks.back().end = out.corners.size();
+            break;
+        }
+        default:
+            break;
+        }
+    }
+}
+
+// Splits the text into up to n chunks that each end on a line boundary
+std::vector<std::string_view> splitLines(std::string_view text, unsigned int n);
+
+// Same as objToJsSequential, but parses newline-aligned chunks of the input
+// concurrently and merges them in file order. The result is identical.
+template <typename Real>
+bool objToJsParallel(std::string_view text, VertexBuffer<Real>& vertexData,
+                     std::vector<unsigned int>& elementData, unsigned int threads,
+                     ParseContext<Real>& context)
+{
+    std::vector<std::string_view> chunks = splitLines(text, threads);
+    std::vector<ChunkRecords<Real>> records(chunks.size());
+    runParallel(chunks.size(), [&](unsigned int c) {
+        parseChunk(chunks[c], vertexData.attribs, records[c]);
+    });
+
+    // Nothing after the first malformed record counts
+    size_t used = 0;
+    while (used < records.size() && !records[used++].error) {}
+    const char* parseError = used ? records[used - 1].error : 0;
+    std::string_view parseErrorDetail = used ? records[used - 1].detail : std::string_view();
+
+    // Concatenate the chunks, remembering where each one starts
+    Attributes<Real>& attribs = context.attribs;
+    std::pmr::vector<VertexKey>& corners = context.corners;
+    std::pmr::vector<FaceRef>& faces = context.faces;
+    std::vector<FaceBlock> blocks;
+    std::vector<size_t> firstBlock(used + 1, 0);
+    for (size_t c = 0; c < used; ++c) {
+        ChunkRecords<Real>& chunk = records[c];
+        for (int k = 0; k <= RecordOther; ++k)
+            context.stats.records[k] += chunk.records[k];
+        const size_t base[3] = {attribs.positions.size(), attribs.texcoords.size(), attribs.normals.size()};
+        for (const FaceBlock& block : chunk.blocks) {
+            blocks.push_back({corners.size() + block.end, {base[0] + block.counts[0],
+                             base[1] + block.counts[1], base[2] + block.counts[2]}});
+        }
+        firstBlock[c + 1] = blocks.size();
+        for (const FaceRef& face : chunk.faces)
+            faces.push_back({corners.size() + face.offset, face.degree});
+
+        attribs.positions.insert(attribs.positions.end(), chunk.attribs.positions.begin(),
+                                 chunk.attribs.positions.end());
+        attribs.texcoords.insert(attribs.texcoords.end(), chunk.attribs.texcoords.begin(),
+                                 chunk.attribs.texcoords.end());
+        attribs.normals.insert(attribs.normals.end(), chunk.attribs.normals.begin(),
+                               chunk.attribs.normals.end());
+        corners.insert(corners.end(), chunk.corners.begin(), chunk.corners.end());
+
+        // Release chunk memory as soon as it is merged
+        chunk = ChunkRecords<Real>();
+    }
+
+    // Resolve the face indices against the attributes defined before each
+    // face, noting the first corner that refers to a missing attribute
+    std::vector<size_t> badCorner(used, ~size_t(0));
+    runParallel(used, [&](unsigned int c) {
+        for (size_t b = firstBlock[c]; b < firstBlock[c + 1] && badCorner[c] == ~size_t(0); ++b) {
+            const FaceBlock& block = blocks[b];
+            size_t begin = b ? blocks[b - 1].end : 0;
+            size_t bad = resolveVertexKeys(&corners[begin], block.end - begin, block.counts, vertexData.attribs);
+            if (OBJTOARR_UNLIKELY(bad != block.end - begin))
+                badCorner[c] = begin + bad;
+        }
+    });
+
+    // Every bad index comes before the malformed record that ended parsing
+    std::string error;
+    for (size_t c = 0; c < used && error.empty(); ++c) {
+        if (badCorner[c] != ~size_t(0))
+            error = "Vertex index out of range: " + formatVertexKey(corners[badCorner[c]]);
+    }
+    if (error.empty() && parseError)
+        error = std::string(parseError) + std::string(parseErrorDetail);
+    if (error.empty() && attribs.positions.empty())
+        error = "Could not parse any vertex positions";
+    if (!error.empty()) {
+        *context.log << error << std::endl;
+        return false;
+    }
+
+    // Replace the fans of larger faces by their proper triangulation
+    runParallel(faces.empty() ? 0 : threads, [&](unsigned int t) {
+        FaceScratch localScratch;
+        FaceScratch& scratch = t ? localScratch : context.scratch;
+        auto range = splitRange(faces.size(), t, threads);
+        for (size_t f = range.first; f < range.second; ++f) {
+            VertexKey* fan = &corners[faces[f].offset];
+            unsigned int degree = faces[f].degree;
+            scratch.keys.resize(degree);
+            scratch.keys[0] = fan[0];
+            for (unsigned int k = 1; k < degree; ++k)
+                scratch.keys[k] = k + 1 < degree ? fan[3 * (k - 1) + 1] : fan[3 * (k - 2) + 2];
+            triangulateFace(attribs.positions, scratch.keys.data(), degree, scratch,
+                            [&](unsigned int a, unsigned int b, unsigned int c) {
+                fan[0] = scratch.keys[a]; fan[1] = scratch.keys[b]; fan[2] = scratch.keys[c];
+                fan += 3;
+            });
+        }
+    });
+
+    dedupVertices(attribs, corners, vertexData, elementData, threads, context.stats);
+    return true;
+}
+
+// Reads a .obj file and parses the vertex positions, texture coordinates,
+// normals, and triangulated faces, using up to the given number of threads.
+// Parsing counters are written to stats if given. Passing a context reuses
+// its buffers and reports errors to its log instead of stderr.
+// Returns true on success, otherwise false.
+template <typename Real>
+bool objToJs(std::string_view text, VertexBuffer<Real>& vertexData, std::vector<unsigned int>& elementData,
+             bool disableTexture = false, bool disableNormal = false, unsigned int threads = 1,
+             ParseStats* stats = 0, ParseContext<Real>* context = 0)
+{
+    ParseContext<Real> localContext;
+    ParseContext<Real>& ctx = context ? *context : localContext;
+    ctx.clear();
+
+    vertexData.setAttributes(attributeFlags(disableTexture, disableNormal));
+    bool ok = threads > 1 ? objToJsParallel(text, vertexData, elementData, threads, ctx)
+                          : objToJsSequential(text, vertexData, elementData, ctx);
+    if (stats)
+        *stats = ctx.stats;
+    return ok;
+}
+
+// Maps the value to an unsigned key that sorts in the same order
+inline uint32_t sortableKey(float value)
+{
+    uint32_t bits;
+    value += 0.0f; // Sort -0 together with 0
+    std::memcpy(&bits, &value, sizeof(bits));
+    return bits & 0x80000000u ? ~bits : bits | 0x80000000u;
+}
+
+inline uint64_t sortableKey(double value)
+{
+    uint64_t bits;
+    value += 0.0;
+    std::memcpy(&bits, &value, sizeof(bits));
+    return bits & 0x8000000000000000ull ? ~bits : bits | 0x8000000000000000ull;
+}
+
+// Stable LSD radix sort of the keys by 8 bit digits, moving the values along.
+// Every thread histograms and scatters its own range of each pass, and digits
+// that are the same for all keys are skipped.
+template <typename K>
+void radixSort(std::vector<K>& keys, std::vector<unsigned int>& values, unsigned int threads)
+{
+    const unsigned int Radix = 256;
+    size_t N = keys.size();
+    threads = std::max(1u, std::min<unsigned int>(threads, N / 65536 + 1));
+    std::vector<K> keyBuffer(N);
+    std::vector<unsigned int> valueBuffer(N);
+    std::vector<size_t> offsets(threads * Radix);
+
+    for (unsigned int shift = 0; shift < 8 * sizeof(K); shift += 8) {
+        // Count the digits in every range
+        std::fill(offsets.begin(), offsets.end(), 0);
+        runParallel(threads, [&](unsigned int t) {
+            auto range = splitRange(N, t, threads);
+            size_t* counts = &offsets[t * Radix];
+            for (size_t i = range.first; i < range.second; ++i)
+                ++counts[(keys[i] >> shift) & (Radix - 1)];
+        });
+
+        // Turn the counts into scatter positions, by digit then by range
+        size_t total = 0;
+        bool trivial = false;
+        for (unsigned int d = 0; d < Radix; ++d) {
+            size_t start = total;
+            for (unsigned int t = 0; t < threads; ++t) {
+                size_t count = offsets[t * Radix + d];
+                offsets[t * Radix + d] = total;
+                total += count;
+            }
+            trivial = trivial || (total - start == N);
+        }
+        if (trivial)
+            continue;
+
+        runParallel(threads, [&](unsigned int t) {
+            auto range = splitRange(N, t, threads);
+            size_t* next = &offsets[t * Radix];
+            for (size_t i = range.first; i < range.second; ++i) {
+                size_t j = next[(keys[i] >> shift) & (Radix - 1)]++;
+                keyBuffer[j] = keys[i];
+                valueBuffer[j] = values[i];
+            }
+        });
+        keys.swap(keyBuffer);
+        values.swap(valueBuffer);
+    }
+}
+
+// Sorts the data by position Z then X value. Returns the mapping from old
+// to new vertex numbers that the indices need to be remapped with.
+// Vertices with the same position keep their order.
+template <typename Real>
+std::vector<unsigned int> sortVerticesZX(VertexBuffer<Real>& data, unsigned int threads = 1)
+{
+    unsigned int N = data.size();
+
+    // Radix sort vertex numbers by z, x
+    std::vector<unsigned int> order(N);
+    for (unsigned int i = 0; i < N; ++i)
+        order[i] = i;
+    if constexpr (sizeof(Real) == 4) {
+        // Both keys fit in one 64 bit key
+        std::vector<uint64_t> keys(N);
+        for (unsigned int i = 0; i < N; ++i)
+            keys[i] = uint64_t(sortableKey(data[i][2])) << 32 | sortableKey(data[i][0]);
+        radixSort(keys, order, threads);
+    } else {
+        // Sort by x, then stable sort by z
+        std::vector<uint64_t> keys(N);
+        for (unsigned int i = 0; i < N; ++i)
+            keys[i] = sortableKey(data[i][0]);
+        radixSort(keys, order, threads);
+        for (unsigned int i = 0; i < N; ++i)
+            keys[i] = sortableKey(data[order[i]][2]);
+        radixSort(keys, order, threads);
+    }
+
+    // Build the index mapping and permute the data once
+    std::vector<unsigned int> mapping(N);
+    std::vector<Real> sortedData(data.data.size());
+    runParallel(threads, [&](unsigned int t) {
+        auto range = splitRange(N, t, threads);
+        for (size_t i = range.first; i < range.second; ++i) {
+            mapping[order[i]] = i;
+            std::copy(data[order[i]], data[order[i]] + data.stride, &sortedData[i * data.stride]);
+        }
+    });
+    data.data.swap(sortedData);
+    return mapping;
+}
+
+// Sorts the data and remaps the indices such that the data is sorted by
+// position Z then X value.
+template <typename Real>
+void sortZX(VertexBuffer<Real>& data, std::vector<unsigned int>& indices, unsigned int threads = 1)
+{
+    std::vector<unsigned int> mapping = sortVerticesZX(data, threads);
+
+    // Write the mapped indices
+    for (unsigned int& i : indices) {
+        i = mapping[i];
+    }
+}
+
+// Cell of a coordinate on a grid of the given cell size, or the exact value
+// when the size is 0
+template <typename Real>
+inline int64_t weldCell(Real value, double cellSize)
+{
+    if (cellSize <= 0)
+        return int64_t(sortableKey(value));
+    // Clamp far away values instead of overflowing
+    double cell = std::floor(value / cellSize);
+    return int64_t(std::max(-0x1p62, std::min(0x1p62, cell)));
+}
+
+inline uint64_t hashCell(int64_t x, int64_t y, int64_t z)
+{
+    uint64_t h = uint64_t(x) * 0x9E3779B97F4A7C15ull ^ uint64_t(y) * 0xC2B2AE3D27D4EB4Full
+               ^ uint64_t(z) * 0x165667B19E3779F9ull;
+    h ^= h >> 32;
+    h *= 0xD6E8FEB86659FD93ull;
+    return h ^ (h >> 32);
+}
+
+// Merges vertices whose attributes all differ by at most epsilon, keeping
+// the first of every group, and compacts the data. Returns the mapping from
+// old to new vertex numbers that the indices need to be remapped with.
+//
+// Vertices are bucketed by their position's cell on a grid of cells twice
+// epsilon wide, so the vertices near one are in the 8 cells around the
+// corner of its cell that it is closest to. Every
+// vertex looks up the first vertex within epsilon from there in parallel,
+// and a linear pass then joins it to that vertex's group if the group's
+// first vertex is within epsilon too, so merging never drifts further.
+template <typename Real>
+std::vector<unsigned int> weldMapping(VertexBuffer<Real>& data, double epsilon, unsigned int threads = 1)
+{
+    size_t N = data.size();
+    unsigned int stride = data.stride;
+    auto within = [&](size_t a, size_t b) {
+        for (unsigned int k = 0; k < stride; ++k) {
+            if (!(std::abs(double(data[a][k]) - double(data[b][k])) <= epsilon))
+                return false;
+        }
+        return true;
+    };
+
+    // Bucket the vertices by the hash of their cell. Their order within a
+    // bucket does not matter, so threads can count and scatter with atomics.
+    size_t mask = 1;
+    while (mask < N)
+        mask <<= 1;
+    --mask;
+    std::vector<int64_t> cells(3 * N);
+    std::vector<size_t> bucketStart(mask + 2, 0);
+    std::vector<unsigned int> members(N);
+    {
+        std::vector<std::atomic<unsigned int>> counts(mask + 1);
+        runParallel(threads, [&](unsigned int t) {
+            auto range = splitRange(mask + 1, t, threads);
+            for (size_t b = range.first; b < range.second; ++b)
+                counts[b].store(0, std::memory_order_relaxed);
+        });
+        runParallel(threads, [&](unsigned int t) {
+            auto range = splitRange(N, t, threads);
+            for (size_t i = range.first; i < range.second; ++i) {
+                int64_t* cell = &cells[3 * i];
+                for (int axis = 0; axis < 3; ++axis)
+                    cell[axis] = weldCell(data[i][axis], 2 * epsilon);
+                counts[hashCell(cell[0], cell[1], cell[2]) & mask].fetch_add(1, std::memory_order_relaxed);
+            }
+        });
+        for (size_t b = 0; b <= mask; ++b) {
+            bucketStart[b + 1] = bucketStart[b] + counts[b].load(std::memory_order_relaxed);
+            counts[b].store(0, std::memory_order_relaxed);
+        }
+        runParallel(threads, [&](unsigned int t) {
+            auto range = splitRange(N, t, threads);
+            for (size_t i = range.first; i < range.second; ++i) {
+                const int64_t* cell = &cells[3 * i];
+                size_t b = hashCell(cell[0], cell[1], cell[2]) & mask;
+                members[bucketStart[b] + counts[b].fetch_add(1, std::memory_order_relaxed)] = i;
+            }
+        });
+    }
+
+    // Find the first vertex within epsilon of every vertex, which may be
+    // the vertex itself. Exact welding only needs the vertex's own cell.
+    std::vector<unsigned int> nearest(N);
+    runParallel(threads, [&](unsigned int t) {
+        auto range = splitRange(N, t, threads);
+        for (size_t i = range.first; i < range.second; ++i) {
+            const int64_t* cell = &cells[3 * i];
+            int64_t side[3] = {0, 0, 0};
+            for (int axis = 0; epsilon > 0 && axis < 3; ++axis)
+                side[axis] = data[i][axis] / (2 * epsilon) - cell[axis] < 0.5 ? -1 : 1;
+            size_t best = i;
+            int corners = epsilon > 0 ? 8 : 1;
+            for (int c = 0; c < corners; ++c) {
+                size_t b = hashCell(cell[0] + (c & 1) * side[0], cell[1] + (c >> 1 & 1) * side[1],
+                                    cell[2] + (c >> 2) * side[2]) & mask;
+                for (size_t m = bucketStart[b]; m < bucketStart[b + 1]; ++m) {
+                    size_t j = members[m];
+                    if (j < best && within(i, j))
+                        best = j;
+                }
+            }
+            nearest[i] = static_cast<unsigned int>(best);
+        }
+    });
+    std::vector<int64_t>().swap(cells);
+    std::vector<size_t>().swap(bucketStart);
+    std::vector<unsigned int>().swap(members);
+
+    // Join every vertex to the group of the vertex it found, unless that
+    // group's first vertex is too far, and number the groups in order.
+    // nearest[i] becomes the first vertex of i's group.
+    std::vector<unsigned int> mapping(N);
+    unsigned int next = 0;
+    for (size_t i = 0; i < N; ++i) {
+        unsigned int group = nearest[nearest[i]];
+        if (group == i || (group != nearest[i] && !within(i, group))) {
+            nearest[i] = i;
+            mapping[i] = next++;
+        } else {
+            nearest[i] = group;
+            mapping[i] = mapping[group];
+        }
+    }
+
+    // Keep the first vertex of every group
+    std::vector<Real> weldedData(size_t(next) * stride);
+    runParallel(threads, [&](unsigned int t) {
+        auto range = splitRange(N, t, threads);
+        for (size_t i = range.first; i < range.second; ++i) {
+            if (nearest[i] == i)
+                std::copy(data[i], data[i] + stride, &weldedData[size_t(mapping[i]) * stride]);
+        }
+    });
+    data.data.swap(weldedData);
+    return mapping;
+}
+
+// Welds the vertices within epsilon of each other, see weldMapping, and
+// remaps the indices. Returns the number of vertices merged away.
+template <typename Real>
+size_t weldVertices(VertexBuffer<Real>& data, std::vector<unsigned int>& indices, double epsilon,
+                    unsigned int threads = 1)
+{
+    size_t before = data.size();
+    std::vector<unsigned int> mapping = weldMapping(data, epsilon, threads);
+    runParallel(threads, [&](unsigned int t) {
+        auto range = splitRange(indices.size(), t, threads);
+        for (size_t i = range.first; i < range.second; ++i)
+            indices[i] = mapping[indices[i]];
+    });
+    return before - data.size();
+}
+
+// Axis-aligned bounding box of the vertex positions
+struct Bounds {
+    double min[3] = {0, 0, 0};
+    double max[3] = {0, 0, 0};
+};
+
+// Affine transform of the positions as a row-major 3 x 4 matrix, p' = M (p, 1)
+struct Transform {
+    double m[3][4] = {{1, 0, 0, 0}, {0, 1, 0, 0}, {0, 0, 1, 0}};
+
+    // Determinant of the linear part, negative for mirroring transforms
+    double determinant() const
+    {
+        return m[0][0] * (m[1][1] * m[2][2] - m[1][2] * m[2][1])
+             - m[0][1] * (m[1][0] * m[2][2] - m[1][2] * m[2][0])
+             + m[0][2] * (m[1][0] * m[2][1] - m[1][1] * m[2][0]);
+    }
+};
+
+// The vertex kernels below copy blocks of this many vertices out of the
+// interleaved buffer into one array per component, and run plain loops of
+// this fixed length over those arrays, which the compiler vectorizes for the
+// target (SSE, AVX, NEON)
+const size_t VertexBlock = 256;
+
+// Copies the three components at the offset of vertices first to first + n
+// into separate arrays, and fills them up to VertexBlock with the first
+// vertex so that kernels can always run over whole blocks
+template <typename Real>
+inline void gatherBlock(const VertexBuffer<Real>& data, size_t first, size_t n, unsigned int offset,
+                        Real* x, Real* y, Real* z)
+{
+    const Real* v = data[first] + offset;
+    for (size_t k = 0; k < n; ++k, v += data.stride) {
+        x[k] = v[0];
+        y[k] = v[1];
+        z[k] = v[2];
+    }
+    std::fill(x + n, x + VertexBlock, x[0]);
+    std::fill(y + n, y + VertexBlock, y[0]);
+    std::fill(z + n, z + VertexBlock, z[0]);
+}
+
+template <typename Real>
+inline void scatterBlock(VertexBuffer<Real>& data, size_t first, size_t n, unsigned int offset,
+                         const Real* x, const Real* y, const Real* z)
+{
+    Real* v = data[first] + offset;
+    for (size_t k = 0; k < n; ++k, v += data.stride) {
+        v[0] = x[k];
+        v[1] = y[k];
+        v[2] = z[k];
+    }
+}
+
+// Gets the bounding box of the positions, with every thread reducing a range
+// of vertices into one minimum and maximum per SIMD lane
+template <typename Real>
+Bounds computeBounds(const VertexBuffer<Real>& data, unsigned int threads = 1)
+{
+    const unsigned int Lanes = 8;
+    size_t N = data.size();
+    Bounds bounds;
+    if (!N)
+        return bounds;
+    threads = std::max(1u, std::min<unsigned int>(threads, (N + VertexBlock - 1) / VertexBlock));
+    std::vector<Bounds> partial(threads);
+    runParallel(threads, [&](unsigned int t) {
+        auto range = splitRange(N, t, threads);
+        alignas(32) Real block[3][VertexBlock];
+        Real low[3][Lanes], high[3][Lanes];
+        for (int axis = 0; axis < 3; ++axis) {
+            std::fill(low[axis], low[axis] + Lanes, std::numeric_limits<Real>::infinity());
+            std::fill(high[axis], high[axis] + Lanes, -std::numeric_limits<Real>::infinity());
+        }
+        for (size_t first = range.first; first < range.second; first += VertexBlock) {
+            size_t n = std::min(VertexBlock, range.second - first);
+            gatherBlock(data, first, n, 0, block[0], block[1], block[2]);
+            for (int axis = 0; axis < 3; ++axis) {
+                for (size_t k = 0; k < VertexBlock; k += Lanes) {
+                    for (unsigned int l = 0; l < Lanes; ++l) {
+                        Real value = block[axis][k + l];
+                        low[axis][l] = value < low[axis][l] ? value : low[axis][l];
+                        high[axis][l] = value > high[axis][l] ? value : high[axis][l];
+                    }
+                }
+            }
+        }
+        for (int axis = 0; axis < 3; ++axis) {
+            partial[t].min[axis] = *std::min_element(low[axis], low[axis] + Lanes);
+            partial[t].max[axis] = *std::max_element(high[axis], high[axis] + Lanes);
+        }
+    });
+    bounds = partial[0];
+    for (const Bounds& b : partial) {
+        for (int axis = 0; axis < 3; ++axis) {
+            bounds.min[axis] = std::min(bounds.min[axis], b.min[axis]);
+            bounds.max[axis] = std::max(bounds.max[axis], b.max[axis]);
+        }
+    }
+    return bounds;
+}
+
+// Transforms the positions, and the normals by the inverse transpose of the
+// linear part so they stay perpendicular to the surface, keeping their
+// lengths. A mirroring transform also reverses the winding of the triangles
+// so they keep facing the same side.
+template <typename Real>
+void transformVertices(VertexBuffer<Real>& data, std::vector<unsigned int>& indices, const Transform& transform,
+                       unsigned int threads = 1)
+{
+    const double (&m)[3][4] = transform.m;
+    Real p[3][4];
+    for (int r = 0; r < 3; ++r)
+        for (int c = 0; c < 4; ++c)
+            p[r][c] = Real(m[r][c]);
+    // The cofactor matrix is the inverse transpose scaled by the determinant,
+    // and has the determinant's sign flipped out so normals keep pointing out
+    double sign = transform.determinant() < 0 ? -1 : 1;
+    Real n[3][3];
+    for (int r = 0; r < 3; ++r) {
+        for (int c = 0; c < 3; ++c) {
+            int r1 = (r + 1) % 3, r2 = (r + 2) % 3, c1 = (c + 1) % 3, c2 = (c + 2) % 3;
+            n[r][c] = Real(sign * (m[r1][c1] * m[r2][c2] - m[r1][c2] * m[r2][c1]));
+        }
+    }
+
+    size_t N = data.size();
+    runParallel(threads, [&](unsigned int t) {
+        auto range = splitRange(N, t, threads);
+        alignas(32) Real x[VertexBlock], y[VertexBlock], z[VertexBlock];
+        for (size_t first = range.first; first < range.second; first += VertexBlock) {
+            size_t count = std::min(VertexBlock, range.second - first);
+            gatherBlock(data, first, count, 0, x, y, z);
+            for (size_t k = 0; k < VertexBlock; ++k) {
+                Real tx = p[0][0] * x[k] + p[0][1] * y[k] + p[0][2] * z[k] + p[0][3];
+                Real ty = p[1][0] * x[k] + p[1][1] * y[k] + p[1][2] * z[k] + p[1][3];
+                Real tz = p[2][0] * x[k] + p[2][1] * y[k] + p[2][2] * z[k] + p[2][3];
+                x[k] = tx;
+                y[k] = ty;
+                z[k] = tz;
+            }
+            scatterBlock(data, first, count, 0, x, y, z);
+            if (!data.hasNormals())
+                continue;
+            gatherBlock(data, first, count, data.normalOffset(), x, y, z);
+            for (size_t k = 0; k < VertexBlock; ++k) {
+                Real tx = n[0][0] * x[k] + n[0][1] * y[k] + n[0][2] * z[k];
+                Real ty = n[1][0] * x[k] + n[1][1] * y[k] + n[1][2] * z[k];
+                Real tz = n[2][0] * x[k] + n[2][1] * y[k] + n[2][2] * z[k];
+                Real before = x[k] * x[k] + y[k] * y[k] + z[k] * z[k];
+                Real after = tx * tx + ty * ty + tz * tz;
+                Real scale = after > 0 ? std::sqrt(before / after) : Real(0);
+                x[k] = tx * scale;
+                y[k] = ty * scale;
+                z[k] = tz * scale;
+            }
+            scatterBlock(data, first, count, data.normalOffset(), x, y, z);
+        }
+    });
+    if (sign < 0) {
+        runParallel(threads, [&](unsigned int t) {
+            auto range = splitRange(indices.size() / 3, t, threads);
+            for (size_t i = range.first; i < range.second; ++i)
+                std::swap(indices[3*i + 1], indices[3*i + 2]);
+        });
+    }
+}
+
+// Scales every nonzero normal to unit length
+template <typename Real>
+void normalizeNormals(VertexBuffer<Real>& data, unsigned int threads = 1)
+{
+    if (!data.hasNormals())
+        return;
+    size_t N = data.size();
+    runParallel(threads, [&](unsigned int t) {
+        auto range = splitRange(N, t, threads);
+        alignas(32) Real x[VertexBlock], y[VertexBlock], z[VertexBlock];
+        for (size_t first = range.first; first < range.second; first += VertexBlock) {
+            size_t count = std::min(VertexBlock, range.second - first);
+            gatherBlock(data, first, count, data.normalOffset(), x, y, z);
+            for (size_t k = 0; k < VertexBlock; ++k) {
+                Real length = std::sqrt(x[k] * x[k] + y[k] * y[k] + z[k] * z[k]);
+                Real scale = length > 0 ? 1 / length : Real(0);
+                x[k] *= scale;
+                y[k] *= scale;
+                z[k] *= scale;
+            }
+            scatterBlock(data, first, count, data.normalOffset(), x, y, z);
+        }
+    });
+}
+
+// Numbers the distinct positions, so vertices that only differ in their
+// other attributes share a number. Returns the number of every vertex and
+// sets count to the number of distinct positions.
+template <typename Real>
+std::vector<unsigned int> positionGroups(const VertexBuffer<Real>& data, unsigned int& count,
+                                         unsigned int threads = 1)
+{
+    size_t N = data.size();
+    std::vector<uint64_t> keys(N);
+    std::vector<unsigned int> order(N);
+    runParallel(threads, [&](unsigned int t) {
+        auto range = splitRange(N, t, threads);
+        for (size_t i = range.first; i < range.second; ++i) {
+            // Adding zero turns -0 into 0, which compares equal to it
+            const Real* p = data[i];
+            keys[i] = hashCell(weldCell(p[0] + Real(0), 0), weldCell(p[1] + Real(0), 0),
+                               weldCell(p[2] + Real(0), 0));
+            order[i] = static_cast<unsigned int>(i);
+        }
+    });
+    radixSort(keys, order, threads);
+
+    // Equal positions are now next to each other, along with the rare
+    // positions whose hashes collide
+    std::vector<unsigned int> groups(N);
+    count = 0;
+    for (size_t run = 0, end; run < N; run = end) {
+        for (end = run + 1; end < N && keys[end] == keys[run]; ++end) {}
+        for (size_t i = run; i < end; ++i) {
+            const Real* p = data[order[i]];
+            size_t j = run;
+            while (j < i && !std::equal(p, p + 3, data[order[j]]))
+                ++j;
+            groups[order[i]] = j < i ? groups[order[j]] : count++;
+        }
+    }
+    return groups;
+}
+
+// Replaces the normals with smooth vertex normals: the normalized sum of the
+// edge cross products of the triangles around the vertex's position, which
+// weights them by area. Vertices that only differ in their texture
+// coordinates get the same normal. Every thread adds its range of triangles
+// into sums of its own, which are added up per position afterwards.
+//
+// With a crease angle below 180 degrees a corner only sums the triangles
+// whose normal is within the angle of its own triangle's, and vertices
+// whose corners end up with different normals are split into copies, so hard
+// edges stay hard. Returns the number of vertices added by splitting.
+template <typename Real>
+size_t generateNormals(VertexBuffer<Real>& data, std::vector<unsigned int>& indices, double creaseAngle = 180,
+                       unsigned int threads = 1)
+{
+    if (!data.hasNormals())
+        return 0;
+    size_t N = data.size(), T = indices.size() / 3;
+    unsigned int groupCount;
+    std::vector<unsigned int> groups = positionGroups(data, groupCount, threads);
+    const unsigned int offset = data.normalOffset();
+
+    // In double precision, as slivers lose most digits of their edges
+    std::vector<double> faceNormals(3 * T);
+    runParallel(threads, [&](unsigned int t) {
+        auto range = splitRange(T, t, threads);
+        for (size_t f = range.first; f < range.second; ++f) {
+            const Real* a = data[indices[3*f]];
+            const Real* b = data[indices[3*f + 1]];
+            const Real* c = data[indices[3*f + 2]];
+            double u[3] = {double(b[0]) - a[0], double(b[1]) - a[1], double(b[2]) - a[2]};
+            double v[3] = {double(c[0]) - a[0], double(c[1]) - a[1], double(c[2]) - a[2]};
+            double* n = &faceNormals[3*f];
+            n[0] = u[1] * v[2] - u[2] * v[1];
+            n[1] = u[2] * v[0] - u[0] * v[2];
+            n[2] = u[0] * v[1] - u[1] * v[0];
+        }
+    });
+    auto setNormal = [&data, offset](size_t i, const double* sum) {
+        double length = std::sqrt(sum[0] * sum[0] + sum[1] * sum[1] + sum[2] * sum[2]);
+        double scale = length > 0 ? 1 / length : 0;
+        for (int axis = 0; axis < 3; ++axis)
+            data[i][offset + axis] = Real(sum[axis] * scale);
+    };
+
+    if (creaseAngle >= 180) {
+        std::vector<std::vector<double>> sums(threads);
+        runParallel(threads, [&](unsigned int t) {
+            std::vector<double>& sum = sums[t];
+            sum.assign(3 * size_t(groupCount), 0.0);
+            auto range = splitRange(T, t, threads);
+            for (size_t f = range.first; f < range.second; ++f) {
+                const double* n = &faceNormals[3*f];
+                for (int k = 0; k < 3; ++k) {
+                    double* s = &sum[3 * size_t(groups[indices[3*f + k]])];
+                    s[0] += n[0];
+                    s[1] += n[1];
+                    s[2] += n[2];
+                }
+            }
+        });
+        runParallel(threads, [&](unsigned int t) {
+            auto range = splitRange(3 * size_t(groupCount), t, threads);
+            for (unsigned int other = 1; other < threads; ++other)
+                for (size_t i = range.first; i < range.second; ++i)
+                    sums[0][i] += sums[other][i];
+        });
+        runParallel(threads, [&](unsigned int t) {
+            auto range = splitRange(N, t, threads);
+            for (size_t i = range.first; i < range.second; ++i)
+                setNormal(i, &sums[0][3 * size_t(groups[i])]);
+        });
+        return 0;
+    }
+
+    // Triangles around every position
+    std::vector<unsigned int> first(size_t(groupCount) + 1, 0), around(3 * T);
+    for (size_t c = 0; c < 3 * T; ++c)
+        ++first[groups[indices[c]] + 1];
+    for (size_t g = 0; g < groupCount; ++g)
+        first[g + 1] += first[g];
+    {
+        std::vector<unsigned int> next(first.begin(), first.end() - 1);
+        for (size_t c = 0; c < 3 * T; ++c)
+            around[next[groups[indices[c]]]++] = static_cast<unsigned int>(c / 3);
+    }
+    std::vector<double> faceLengths(T);
+    runParallel(threads, [&](unsigned int t) {
+        auto range = splitRange(T, t, threads);
+        for (size_t f = range.first; f < range.second; ++f) {
+            const double* n = &faceNormals[3*f];
+            faceLengths[f] = std::sqrt(n[0] * n[0] + n[1] * n[1] + n[2] * n[2]);
+        }
+    });
+
+    // Normal of every corner from the triangles within the angle, or all of
+    // them around a degenerate triangle
+    const double pi = 3.14159265358979323846;
+    const double cosine = std::cos(creaseAngle * pi / 180);
+    std::vector<Real> cornerNormals(9 * T);
+    runParallel(threads, [&](unsigned int t) {
+        auto range = splitRange(T, t, threads);
+        for (size_t f = range.first; f < range.second; ++f) {
+            const double* own = &faceNormals[3*f];
+            for (int k = 0; k < 3; ++k) {
+                unsigned int g = groups[indices[3*f + k]];
+                double sum[3] = {0, 0, 0};
+                for (unsigned int j = first[g]; j < first[g + 1]; ++j) {
+                    const double* n = &faceNormals[3 * size_t(around[j])];
+                    double dot = own[0] * n[0] + own[1] * n[1] + own[2] * n[2];
+                    if (faceLengths[f] > 0 && dot < cosine * faceLengths[f] * faceLengths[around[j]])
+                        continue;
+                    sum[0] += n[0];
+                    sum[1] += n[1];
+                    sum[2] += n[2];
+                }
+                double length = std::sqrt(sum[0] * sum[0] + sum[1] * sum[1] + sum[2] * sum[2]);
+                double scale = length > 0 ? 1 / length : 0;
+                for (int axis = 0; axis < 3; ++axis)
+                    cornerNormals[9*f + 3*k + axis] = Real(sum[axis] * scale);
+            }
+        }
+    });
+
+    // The first corner of a vertex gives it its normal. Corners with another
+    // normal move to a copy of the vertex with theirs, shared by all such
+    // corners, chained from the vertex.
+    const unsigned int none = ~0u;
+    std::vector<unsigned int> copies(N, none);
+    std::vector<char> assigned(N, 0);
+    for (size_t c = 0; c < 3 * T; ++c) {
+        const Real* normal = &cornerNormals[3*c];
+        unsigned int v = indices[c];
+        while (assigned[v] && !std::equal(normal, normal + 3, data[v] + offset) && copies[v] != none)
+            v = copies[v];
+        if (assigned[v] && !std::equal(normal, normal + 3, data[v] + offset)) {
+            unsigned int copy = static_cast<unsigned int>(data.size());
+            data.resize(data.size() + 1);
+            std::copy(data[v], data[v] + data.stride, data[copy]);
+            copies[v] = copy;
+            copies.push_back(none);
+            assigned.push_back(0);
+            v = copy;
+        }
+        if (!assigned[v]) {
+            std::copy(normal, normal + 3, data[v] + offset);
+            assigned[v] = 1;
+        }
+        indices[c] = v;
+    }
+    return data.size() - N;
+}
+
+// Gets the average cache miss ratio (ACMR), transformed vertices per
+// triangle, of drawing the indexed triangles through a FIFO post-transform
+// vertex cache of the given size
+double vertexCacheMissRatio(const std::vector<unsigned int>& indices, size_t vertexCount,
+                            unsigned int cacheSize = 16);
+
+// Reorders the triangles for reuse in a FIFO post-transform vertex cache of
+// the given size, with the Tipsify algorithm of Sander, Nehab and Barczak.
+// Runs in linear time and leaves the triangles' windings intact.
+void optimizeVertexCache(std::vector<unsigned int>& indices, size_t vertexCount,
+                         unsigned int cacheSize = 16);
+
+// Permutes the vertices into the order the indices first use them, so
+// vertex fetches walk memory sequentially, and remaps the indices
+template <typename Real>
+void optimizeVertexFetch(VertexBuffer<Real>& data, std::vector<unsigned int>& indices)
+{
+    const unsigned int unused = ~0u;
+    size_t N = data.size();
+    std::vector<unsigned int> mapping(N, unused);
+    std::vector<Real> orderedData(data.data.size());
+    unsigned int next = 0;
+    for (unsigned int& i : indices) {
+        if (mapping[i] == unused) {
+            std::copy(data[i], data[i] + data.stride, &orderedData[size_t(next) * data.stride]);
+            mapping[i] = next++;
+        }
+        i = mapping[i];
+    }
+    // Vertices no triangle uses go last
+    for (size_t i = 0; i < N; ++i) {
+        if (mapping[i] == unused)
+            std::copy(data[i], data[i] + data.stride, &orderedData[size_t(next++) * data.stride]);
+    }
+    data.data.swap(orderedData);
+}
+
+// A part of the mesh with a bounded number of vertices and triangles. The
+// vertices of a meshlet are contiguous, and its triangles only use them.
+struct Meshlet {
+    unsigned int vertexOffset, vertexCount; // Range in the vertex buffer
+    unsigned int indexOffset, indexCount;   // Range in the index buffer
+    float center[3], radius;                // Bounding sphere
+    float min[3], max[3];                   // Bounding box
+};
+
+// Spreads the low 21 bits of the value to every third bit
+inline uint64_t spreadBits(uint64_t x)
+{
+    x &= 0x1FFFFF;
+    x = (x | x << 32) & 0x1F00000000FFFFull;
+    x = (x | x << 16) & 0x1F0000FF0000FFull;
+    x = (x | x << 8) & 0x100F00F00F00F00Full;
+    x = (x | x << 4) & 0x10C30C30C30C30C3ull;
+    x = (x | x << 2) & 0x1249249249249249ull;
+    return x;
+}
+
+// Splits the mesh into meshlets of at most maxVertices vertices and
+// maxTriangles triangles. Each meshlet starts at the first unused triangle
+// along a Morton curve of the centroids and grows greedily by the adjacent
+// triangle that adds the fewest vertices, so meshlets are compact. The curve
+// is cut into spans of 65536 triangles that are partitioned in parallel, so
+// no meshlet crosses a span and the result does not depend on the threads.
+// Vertices shared between meshlets are duplicated, and the vertex and
+// index buffers are rewritten in meshlet order.
+template <typename Real>
+std::vector<Meshlet> buildMeshlets(VertexBuffer<Real>& data, std::vector<unsigned int>& indices,
+                                   unsigned int maxVertices = 64, unsigned int maxTriangles = 124,
+                                   unsigned int threads = 1)
+{
+    std::vector<Meshlet> meshlets;
+    size_t T = indices.size() / 3, N = data.size();
+    if (!T)
+        return meshlets;
+    maxVertices = std::max(3u, maxVertices);
+    maxTriangles = std::max(1u, maxTriangles);
+
+    // Order the triangles by the Morton code of their centroids
+    double low[3], high[3];
+    for (int axis = 0; axis < 3; ++axis) {
+        low[axis] = std::numeric_limits<double>::infinity();
+        high[axis] = -low[axis];
+    }
+    for (size_t i = 0; i < N; ++i) {
+        for (int axis = 0; axis < 3; ++axis) {
+            low[axis] = std::min(low[axis], double(data[i][axis]));
+            high[axis] = std::max(high[axis], double(data[i][axis]));
+        }
+    }
+    // One scale for all axes keeps the curve isotropic on flat meshes
+    double extent = std::max({high[0] - low[0], high[1] - low[1], high[2] - low[2]});
+    double scale = extent > 0 ? 0x1FFFFF / extent : 0;
+    std::vector<uint64_t> keys(T);
+    std::vector<unsigned int> order(T);
+    runParallel(threads, [&](unsigned int t) {
+        auto range = splitRange(T, t, threads);
+        for (size_t i = range.first; i < range.second; ++i) {
+            uint64_t key = 0;
+            for (int axis = 0; axis < 3; ++axis) {
+                double centroid = (double(data[indices[3*i]][axis]) + data[indices[3*i + 1]][axis]
+                                   + data[indices[3*i + 2]][axis]) / 3;
+                // Clamped, and NaN or infinite positions go to cell 0
+                double cell = (centroid - low[axis]) * scale;
+                key |= spreadBits(uint64_t(cell >= 0 ? std::min(cell, double(0x1FFFFF)) : 0)) << axis;
+            }
+            keys[i] = key;
+            order[i] = static_cast<unsigned int>(i);
+        }
+    });
+    radixSort(keys, order, threads);
+    std::vector<uint64_t>().swap(keys);
+
+    // Triangles around every vertex
+    std::vector<size_t> firstTriangle(N + 1, 0);
+    for (size_t i = 0; i < 3 * T; ++i)
+        ++firstTriangle[indices[i] + 1];
+    for (size_t v = 0; v < N; ++v)
+        firstTriangle[v + 1] += firstTriangle[v];
+    std::vector<unsigned int> adjacency(3 * T);
+    {
+        std::vector<size_t> next(firstTriangle.begin(), firstTriangle.end() - 1);
+        for (size_t i = 0; i < 3 * T; ++i)
+            adjacency[next[indices[i]]++] = static_cast<unsigned int>(i / 3);
+    }
+
+    // Grow meshlets in fixed spans of the curve, each span on its own, so
+    // spans run in parallel and the result does not depend on the thread
+    // count. Every meshlet starts from the first unused triangle of its span
+    // and takes the neighbouring triangle of the span that adds the fewest
+    // vertices.
+    const size_t spanTriangles = 1 << 16;
+    size_t spans = (T + spanTriangles - 1) / spanTriangles;
+    std::vector<unsigned int> spanOf(T);
+    for (size_t k = 0; k < T; ++k)
+        spanOf[order[k]] = static_cast<unsigned int>(k / spanTriangles);
+    struct Span {
+        std::vector<Meshlet> meshlets;
+        std::vector<unsigned int> sources; // Original vertex of every new vertex
+        std::vector<unsigned int> packed;  // New indices from the span's first vertex
+    };
+    std::vector<Span> results(spans);
+    // Bytes rather than bits, as spans mark their own triangles concurrently
+    std::vector<char> emitted(T, false);
+    unsigned int spanThreads = static_cast<unsigned int>(std::min<size_t>(threads, spans));
+    runParallel(spanThreads, [&](unsigned int thread) {
+        const unsigned int unseen = ~0u;
+        std::vector<unsigned int> seenIn(N, unseen), localIndex(N);
+        std::vector<unsigned int> candidates;
+        // Meshlet ids stay unique over all spans of the thread
+        unsigned int idBase = 0;
+        auto range = splitRange(spans, thread, spanThreads);
+        for (size_t span = range.first; span < range.second; ++span) {
+            size_t begin = span * spanTriangles, end = std::min(T, begin + spanTriangles);
+            std::vector<Meshlet>& spanMeshlets = results[span].meshlets;
+            std::vector<unsigned int>& sources = results[span].sources;
+            std::vector<unsigned int>& packed = results[span].packed;
+            packed.resize(3 * (end - begin));
+            sources.reserve(3 * (end - begin) / 2);
+            candidates.clear();
+            size_t cursor = begin;
+            auto newVertices = [&](unsigned int t, unsigned int id) {
+                const unsigned int* corners = &indices[3 * size_t(t)];
+                unsigned int added = 0;
+                for (int c = 0; c < 3; ++c) {
+                    bool repeated = (c > 0 && corners[c] == corners[0]) || (c > 1 && corners[c] == corners[1]);
+                    added += !repeated && seenIn[corners[c]] != id;
+                }
+                return added;
+            };
+            for (size_t k = 0; k < end - begin; ++k) {
+                unsigned int id = static_cast<unsigned int>(idBase + spanMeshlets.size() - 1);
+                long best = -1;
+                unsigned int bestAdded = 4;
+                if (!spanMeshlets.empty() && spanMeshlets.back().indexCount < 3 * maxTriangles) {
+                    // Drop used candidates while scanning, stopping at a free one
+                    size_t kept = 0, next = 0;
+                    while (next < candidates.size() && bestAdded > 0) {
+                        unsigned int t = candidates[next++];
+                        if (emitted[t])
+                            continue;
+                        candidates[kept++] = t;
+                        unsigned int added = newVertices(t, id);
+                        if (added < bestAdded && spanMeshlets.back().vertexCount + added <= maxVertices) {
+                            best = t;
+                            bestAdded = added;
+                        }
+                    }
+                    kept = std::copy(candidates.begin() + next, candidates.end(), candidates.begin() + kept)
+                        - candidates.begin();
+                    candidates.resize(kept);
+                }
+                if (best < 0) {
+                    while (emitted[order[cursor]])
+                        ++cursor;
+                    best = order[cursor];
+                    if (spanMeshlets.empty() || spanMeshlets.back().indexCount == 3 * maxTriangles
+                            || spanMeshlets.back().vertexCount + newVertices(best, id) > maxVertices) {
+                        Meshlet m = {};
+                        m.vertexOffset = static_cast<unsigned int>(sources.size());
+                        m.indexOffset = static_cast<unsigned int>(3 * k);
+                        spanMeshlets.push_back(m);
+                        candidates.clear();
+                        id = static_cast<unsigned int>(idBase + spanMeshlets.size() - 1);
+                    }
+                }
+
+                Meshlet& m = spanMeshlets.back();
+                emitted[best] = true;
+                for (int c = 0; c < 3; ++c) {
+                    unsigned int v = indices[3 * size_t(best) + c];
+                    if (seenIn[v] != id) {
+                        seenIn[v] = id;
+                        localIndex[v] = m.vertexCount++;
+                        sources.push_back(v);
+                        // Triangles of other spans belong to other threads
+                        for (size_t a = firstTriangle[v]; a < firstTriangle[v + 1]; ++a) {
+                            unsigned int t = adjacency[a];
+                            if (spanOf[t] == span && !emitted[t])
+                                candidates.push_back(t);
+                        }
+                    }
+                    packed[3*k + c] = m.vertexOffset + localIndex[v];
+                }
+                m.indexCount += 3;
+            }
+            idBase += static_cast<unsigned int>(spanMeshlets.size());
+        }
+    });
+
+    // Concatenate the spans in curve order
+    std::vector<size_t> vertexBase(spans + 1, 0), meshletBase(spans + 1, 0);
+    for (size_t span = 0; span < spans; ++span) {
+        vertexBase[span + 1] = vertexBase[span] + results[span].sources.size();
+        meshletBase[span + 1] = meshletBase[span] + results[span].meshlets.size();
+    }
+    meshlets.resize(meshletBase[spans]);
+    std::vector<unsigned int> sources(vertexBase[spans]);
+    std::vector<unsigned int> packed(3 * T); // New indices in meshlet order
+    runParallel(threads, [&](unsigned int t) {
+        auto range = splitRange(spans, t, threads);
+        for (size_t span = range.first; span < range.second; ++span) {
+            Span& result = results[span];
+            unsigned int vertexOffset = static_cast<unsigned int>(vertexBase[span]);
+            unsigned int indexOffset = static_cast<unsigned int>(3 * span * spanTriangles);
+            for (size_t i = 0; i < result.meshlets.size(); ++i) {
+                Meshlet& m = meshlets[meshletBase[span] + i];
+                m = result.meshlets[i];
+                m.vertexOffset += vertexOffset;
+                m.indexOffset += indexOffset;
+            }
+            std::copy(result.sources.begin(), result.sources.end(), sources.begin() + vertexOffset);
+            for (size_t i = 0; i < result.packed.size(); ++i)
+                packed[indexOffset + i] = result.packed[i] + vertexOffset;
+            result = Span();
+        }
+    });
+
+    // Gather the vertices and bound every meshlet
+    std::vector<Real> meshletData(sources.size() * data.stride);
+    runParallel(threads, [&](unsigned int t) {
+        auto range = splitRange(meshlets.size(), t, threads);
+        for (size_t i = range.first; i < range.second; ++i) {
+            Meshlet& m = meshlets[i];
+            for (unsigned int v = m.vertexOffset; v < m.vertexOffset + m.vertexCount; ++v)
+                std::copy(data[sources[v]], data[sources[v]] + data.stride, &meshletData[size_t(v) * data.stride]);
+            const Real* first = &meshletData[size_t(m.vertexOffset) * data.stride];
+            for (int axis = 0; axis < 3; ++axis)
+                m.min[axis] = m.max[axis] = float(first[axis]);
+            for (unsigned int v = 1; v < m.vertexCount; ++v) {
+                const Real* p = first + size_t(v) * data.stride;
+                for (int axis = 0; axis < 3; ++axis) {
+                    m.min[axis] = std::min(m.min[axis], float(p[axis]));
+                    m.max[axis] = std::max(m.max[axis], float(p[axis]));
+                }
+            }
+            double radius = 0;
+            for (int axis = 0; axis < 3; ++axis)
+                m.center[axis] = (m.min[axis] + m.max[axis]) / 2;
+            for (unsigned int v = 0; v < m.vertexCount; ++v) {
+                const Real* p = first + size_t(v) * data.stride;
+                double dx = p[0] - m.center[0], dy = p[1] - m.center[1], dz = p[2] - m.center[2];
+                radius = std::max(radius, dx*dx + dy*dy + dz*dz);
+            }
+            // Round up so float rounding never leaves a vertex outside
+            m.radius = std::nextafter(float(std::sqrt(radius)), std::numeric_limits<float>::infinity());
+        }
+    });
+    data.data.swap(meshletData);
+    packed.insert(packed.end(), indices.begin() + 3 * T, indices.end());
+    indices.swap(packed);
+    return meshlets;
+}
+
+// The positions of a mesh to simplify. Vertices that only differ in their
+// normal or texture coordinates share a position and move together.
+struct SimplifyMesh {
+    std::vector<unsigned int> vertexPosition; // Position of every vertex
+    std::vector<double> positions;            // x, y, z of every position
+};
+
+// Simplifies the triangles to about targetTriangles by quadric error edge
+// collapse (Garland and Heckbert). Every collapse moves the vertices of one
+// position onto a neighbouring position, so the result uses a subset of the
+// same vertices and the vertex buffer is shared by all levels of detail.
+// Collapses go cheapest first in passes of non-overlapping edges, and never
+// flip a triangle, make the mesh non-manifold or tear an attribute seam.
+// Open borders only collapse along themselves. Large meshes are first
+// simplified as Morton ordered parts on the given number of threads, with
+// the positions shared between parts locked, and then as a whole. The result
+// does not depend on the number of threads.
+std::vector<unsigned int> simplifyTriangles(const SimplifyMesh& mesh, const std::vector<unsigned int>& indices,
+                                            size_t targetTriangles, unsigned int threads = 1);
+
+// Builds a level of detail for every ratio, each simplified from the one
+// before to the ratio of the triangles of the full mesh, see
+// simplifyTriangles. Returns the index array of every level.
+template <typename Real>
+std::vector<std::vector<unsigned int>> buildLods(const VertexBuffer<Real>& data,
+                                                 const std::vector<unsigned int>& indices,
+                                                 const std::vector<double>& ratios, unsigned int threads = 1)
+{
+    SimplifyMesh mesh;
+    unsigned int count;
+    mesh.vertexPosition = positionGroups(data, count, threads);
+    mesh.positions.resize(3 * size_t(count));
+    for (size_t i = 0, N = data.size(); i < N; ++i)
+        std::copy(data[i], data[i] + 3, &mesh.positions[3 * size_t(mesh.vertexPosition[i])]);
+
+    std::vector<std::vector<unsigned int>> lods;
+    size_t triangles = indices.size() / 3;
+    for (double ratio : ratios) {
+        size_t target = static_cast<size_t>(ratio * triangles + 0.5);
+        std::vector<unsigned int> lod = simplifyTriangles(mesh, lods.empty() ? indices : lods.back(), target,
+                                                          threads);
+        lods.push_back(std::move(lod));
+    }
+    return lods;
+}
+
+// Writes the vertex as a comma separated list of its attributes
+template <typename Real>
+void writeVertex(OutputBuffer& out, const Real* v, unsigned int stride, int precision)
+{
+    out.writeNumber(v[0], precision);
+    for (unsigned int i = 1; i < stride; ++i) {
+        out.write(", ");
+        out.writeNumber(v[i], precision);
+    }
+}
+
+// Calls format(buffer, first, last) to format items [first, last) of count
+// items. With several threads, rounds of consecutive blocks are formatted
+// into one in-memory buffer per thread and then written out in order, so
+// memory use stays bounded by the blocks of one round.
+template <typename F>
+void writeParallel(OutputBuffer& out, size_t count, size_t blockSize, unsigned int threads, F format)
+{
+    if (threads <= 1 || count <= blockSize) {
+        format(out, 0, count);
+        return;
+    }
+    std::vector<OutputBuffer> buffers(threads);
+    for (size_t start = 0; start < count; start += threads * blockSize) {
+        runParallel(threads, [&](unsigned int t) {
+            size_t first = std::min(count, start + t * blockSize);
+            buffers[t].clear();
+            format(buffers[t], first, std::min(count, first + blockSize));
+        });
+        // Blocks larger than the output's buffer bypass it in one write
+        for (const OutputBuffer& buffer : buffers)
+            out.write(buffer.view());
+    }
+}
+
+// Writes the vertex buffer array with one vertex per line, formatting
+// blocks of vertices on the given number of threads
+template <typename Real>
+void writeVertexArray(OutputBuffer& out, const VertexBuffer<Real>& vbo, std::string_view indent, int precision,
+                      unsigned int threads = 1)
+{
+    out.write(indent); out.write("// Vertex Buffer Object\n");
+    writeParallel(out, vbo.size(), 1 << 15, threads, [&](OutputBuffer& buffer, size_t first, size_t last) {
+        for (size_t i = first; i < last; ++i) {
+            buffer.write(indent);
+            writeVertex(buffer, vbo[i], vbo.stride, precision);
+            buffer.write(",\n");
+        }
+    });
+    out.put('\n');
+}
+
+// Writes a block of the element index array with one triangle per line.
+// First is the position of the block within the whole array.
+void writeIndices(OutputBuffer& out, const unsigned int* indices, size_t count, size_t first,
+                  std::string_view indent, unsigned int threads = 1);
+
+// Writes the vertex buffer with one vertex per line, then the element index
+// array with one triangle per line, formatting on the given number of threads
+template <typename Real>
+void writeArrays(OutputBuffer& out, const VertexBuffer<Real>& vbo, const std::vector<unsigned int>& ebo,
+                 std::string_view indent, int precision, unsigned int threads = 1)
+{
+    writeVertexArray(out, vbo, indent, precision, threads);
+    out.write(indent); out.write("// Element Index Array\n");
+    writeIndices(out, ebo.data(), ebo.size(), 0, indent, threads);
+    out.put('\n');
+}
+
+// Writes the meshlet table with one meshlet per line: vertex offset and
+// count, index offset and count, bounding sphere center and radius, and
+// bounding box minimum and maximum
+void writeMeshlets(OutputBuffer& out, const std::vector<Meshlet>& meshlets, std::string_view indent,
+                   int precision);
+
+// Writes the index array of every level of detail with one triangle per
+// line, after a "// Element Index Array LOD n" line counting from 1
+void writeLods(OutputBuffer& out, const std::vector<std::vector<unsigned int>>& lods, std::string_view indent,
+               unsigned int threads = 1);
+
+// Writes the bounding box as a comment line, with the digits of the Real
+// vertex data
+template <typename Real>
+void writeBounds(OutputBuffer& out, const Bounds& bounds, std::string_view indent, int precision)
+{
+    out.write(indent);
+    out.write("// Bounds: min ");
+    for (int axis = 0; axis < 3; ++axis) {
+        out.writeNumber(Real(bounds.min[axis]), precision);
+        out.write(axis < 2 ? ", " : ", max ");
+    }
+    for (int axis = 0; axis < 3; ++axis) {
+        out.writeNumber(Real(bounds.max[axis]), precision);
+        out.write(axis < 2 ? ", " : "\n");
+    }
+}
+
+// Appends the value in little-endian byte order
+inline void writeLittleEndian(OutputBuffer& out, uint32_t value, unsigned int bytes = 4)
+{
+    char data[4];
+    for (unsigned int i = 0; i < bytes; ++i)
+        data[i] = static_cast<char>(value >> (8 * i));
+    out.write(std::string_view(data, bytes));
+}
+
+inline void writeLittleEndian(OutputBuffer& out, float value)
+{
+    uint32_t bits;
+    std::memcpy(&bits, &value, sizeof(bits));
+    writeLittleEndian(out, bits);
+}
+
+// Gets the size in bytes of every index in the binary format
+template <typename Real>
+inline unsigned int binaryIndexSize(const VertexBuffer<Real>& vbo)
+{
+    return vbo.size() < 65536 ? 2 : 4;
+}
+
+// Texture coordinate encodings of the quantized binary format
+enum TexcoordEncoding {
+    TexcoordHalf = 1,   // float16
+    TexcoordUnorm16 = 2 // uint16 normalized over the texture coordinate bounds
+};
+
+// Settings and per-mesh bounds for writing quantized vertices. Positions
+// are stored as normalized int16 over their bounding box, normals as two
+// octahedral int8 and texture coordinates in the texcoord encoding.
+struct Quantization {
+    TexcoordEncoding texcoords = TexcoordHalf;
+    float positionOffset[3] = {0, 0, 0}; // Center of the bounding box
+    float positionScale[3] = {1, 1, 1};  // Half extent of the bounding box
+    float texcoordOffset[2] = {0, 0};    // Minimum, for unorm16
+    float texcoordScale[2] = {1, 1};     // Extent, for unorm16
+};
+
+// Gets the quantization bounds of the vertices
+template <typename Real>
+Quantization quantizationBounds(const VertexBuffer<Real>& vbo, TexcoordEncoding texcoords)
+{
+    Quantization q;
+    q.texcoords = texcoords;
+    size_t N = vbo.size();
+    if (!N)
+        return q;
+    Bounds bounds = computeBounds(vbo);
+    for (int axis = 0; axis < 3; ++axis) {
+        double low = bounds.min[axis], high = bounds.max[axis];
+        q.positionOffset[axis] = float((low + high) / 2);
+        q.positionScale[axis] = high > low ? float((high - low) / 2) : 1.0f;
+    }
+    if (vbo.hasTexcoords()) {
+        unsigned int offset = vbo.texcoordOffset();
+        for (int axis = 0; axis < 2; ++axis) {
+            Real low = vbo[0][offset + axis], high = low;
+            for (size_t i = 1; i < N; ++i) {
+                low = std::min(low, vbo[i][offset + axis]);
+                high = std::max(high, vbo[i][offset + axis]);
+            }
+            q.texcoordOffset[axis] = float(low);
+            q.texcoordScale[axis] = high > low ? float(double(high) - low) : 1.0f;
+        }
+    }
+    return q;
+}
+
+// Converts to IEEE 754 half precision, rounding to nearest even
+inline uint16_t floatToHalf(float value)
+{
+    uint32_t bits;
+    std::memcpy(&bits, &value, sizeof(bits));
+    uint32_t sign = (bits >> 16) & 0x8000;
+    uint32_t magnitude = bits & 0x7FFFFFFF;
+    if (magnitude >= 0x7F800000) // Infinity or NaN
+        return sign | 0x7C00 | (magnitude > 0x7F800000 ? 0x200 : 0);
+    if (magnitude >= 0x477FF000) // Rounds to beyond the largest half
+        return sign | 0x7C00;
+    if (magnitude < 0x38800000) { // Subnormal half, or zero
+        if (magnitude < 0x33000000)
+            return sign;
+        uint32_t shift = 126 - (magnitude >> 23);
+        uint32_t mantissa = (magnitude & 0x7FFFFF) | 0x800000;
+        uint32_t half = mantissa >> shift;
+        uint32_t rest = mantissa & ((1u << shift) - 1), midpoint = 1u << (shift - 1);
+        half += rest > midpoint || (rest == midpoint && (half & 1));
+        return sign | half;
+    }
+    uint32_t half = (magnitude - 0x38000000) >> 13;
+    uint32_t rest = magnitude & 0x1FFF;
+    half += rest > 0x1000 || (rest == 0x1000 && (half & 1));
+    return sign | half;
+}
+
+// Maps the value from [-1, 1] to a normalized signed integer with the
+// given largest value
+inline int quantizeSnorm(double value, int largest)
+{
+    return int(std::lround(std::max(-1.0, std::min(1.0, value)) * largest));
+}
+
+// Encodes a normal as a point on the octahedron unfolded to [-1, 1]^2
+inline void octahedralEncode(double x, double y, double z, double out[2])
+{
+    double length = std::fabs(x) + std::fabs(y) + std::fabs(z);
+    if (length == 0) {
+        out[0] = out[1] = 0;
+        return;
+    }
+    x /= length;
+    y /= length;
+    if (z < 0) {
+        double folded = (1 - std::fabs(y)) * (x >= 0 ? 1 : -1);
+        y = (1 - std::fabs(x)) * (y >= 0 ? 1 : -1);
+        x = folded;
+    }
+    out[0] = x;
+    out[1] = y;
+}
+
+// Gets the size in bytes of a vertex in the binary format
+template <typename Real>
+inline unsigned int binaryStride(const VertexBuffer<Real>& vbo, const Quantization* quantization)
+{
+    if (!quantization)
+        return 4 * vbo.stride;
+    return 8 + 4 * vbo.hasNormals() + 4 * vbo.hasTexcoords();
+}
+
+// Writes one vertex in the quantized layout: int16 x, y, z and padding,
+// then int8 octahedral normal and padding, then the texture coordinate
+template <typename Real>
+void writeQuantizedVertex(OutputBuffer& out, const VertexBuffer<Real>& vbo, const Real* v,
+                          const Quantization& q)
+{
+    for (int axis = 0; axis < 3; ++axis) {
+        double unit = (double(v[axis]) - q.positionOffset[axis]) / q.positionScale[axis];
+        writeLittleEndian(out, uint32_t(quantizeSnorm(unit, 32767)), 2);
+    }
+    writeLittleEndian(out, 0u, 2);
+    if (vbo.hasNormals()) {
+        const Real* n = v + vbo.normalOffset();
+        double encoded[2];
+        octahedralEncode(n[0], n[1], n[2], encoded);
+        writeLittleEndian(out, uint32_t(quantizeSnorm(encoded[0], 127)), 1);
+        writeLittleEndian(out, uint32_t(quantizeSnorm(encoded[1], 127)), 1);
+        writeLittleEndian(out, 0u, 2);
+    }
+    if (vbo.hasTexcoords()) {
+        const Real* t = v + vbo.texcoordOffset();
+        for (int axis = 0; axis < 2; ++axis) {
+            uint32_t value = q.texcoords == TexcoordHalf
+                ? floatToHalf(float(t[axis]))
+                : uint32_t(std::lround(std::max(0.0, std::min(1.0,
+                      (double(t[axis]) - q.texcoordOffset[axis]) / q.texcoordScale[axis])) * 65535));
+            writeLittleEndian(out, value, 2);
+        }
+    }
+}
+
+// Writes the binary header and vertex data, see writeBinary
+template <typename Real>
+void writeBinaryVertices(OutputBuffer& out, const VertexBuffer<Real>& vbo, size_t indexCount,
+                         const Quantization* quantization = 0, bool encodeIndices = false)
+{
+    const uint32_t absent = 0xFFFFFFFF;
+    unsigned int stride = binaryStride(vbo, quantization);
+    unsigned int normalOffset = quantization ? 8 : 4 * vbo.normalOffset();
+    unsigned int texcoordOffset = quantization ? 8 + 4 * vbo.hasNormals() : 4 * vbo.texcoordOffset();
+
+    out.write("OBJA");
+    writeLittleEndian(out, quantization ? 2u : 1u);
+    writeLittleEndian(out, static_cast<uint32_t>(vbo.size()));
+    writeLittleEndian(out, static_cast<uint32_t>(indexCount));
+    writeLittleEndian(out, stride);
+    writeLittleEndian(out, encodeIndices ? 0 : binaryIndexSize(vbo));
+    writeLittleEndian(out, vbo.hasNormals() ? normalOffset : absent);
+    writeLittleEndian(out, vbo.hasTexcoords() ? texcoordOffset : absent);
+
+    if (quantization) {
+        const Quantization& q = *quantization;
+        writeLittleEndian(out, uint32_t(q.texcoords));
+        for (float value : q.positionOffset)
+            writeLittleEndian(out, value);
+        for (float value : q.positionScale)
+            writeLittleEndian(out, value);
+        for (float value : q.texcoordOffset)
+            writeLittleEndian(out, value);
+        for (float value : q.texcoordScale)
+            writeLittleEndian(out, value);
+        writeLittleEndian(out, 0u);
+        for (size_t i = 0, N = vbo.size(); i < N; ++i)
+            writeQuantizedVertex(out, vbo, vbo[i], q);
+        return;
+    }
+
+#if __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+    // Float data is already in its final layout
+    if (std::is_same<Real, float>::value) {
+        out.write(std::string_view(reinterpret_cast<const char*>(vbo.data.data()),
+                                   vbo.data.size() * sizeof(Real)));
+        return;
+    }
+#endif
+    for (Real value : vbo.data)
+        writeLittleEndian(out, float(value));
+}
+
+// Writes a block of indices in the binary format, see writeBinary
+template <typename Real>
+void writeBinaryIndices(OutputBuffer& out, const VertexBuffer<Real>& vbo,
+                        const unsigned int* indices, size_t count)
+{
+    unsigned int indexSize = binaryIndexSize(vbo);
+    for (size_t i = 0; i < count; ++i)
+        writeLittleEndian(out, indices[i], indexSize);
+}
+
+// Writes indices in the encoded binary format: every index as its difference
+// from the previous one (from 0 for the first), taken modulo 2^32 as an
+// int32, zigzag mapped (0, -1, 1, -2, ... to 0, 1, 2, 3, ...) and written as
+// a base 128 varint of 1 to 5 bytes, low 7 bits first with the high bit set
+// on all but the last byte. Indices in vertex cache order mostly take one
+// byte. Blocks of one index array go through the same encoder.
+class IndexEncoder {
+public:
+    void encode(OutputBuffer& out, const unsigned int* indices, size_t count)
+    {
+        char bytes[5 * 256];
+        for (size_t first = 0; first < count; first += 256) {
+            size_t used = 0;
+            for (size_t i = first, end = std::min(count, first + 256); i < end; ++i) {
+                uint32_t delta = uint32_t(indices[i]) - previous;
+                uint32_t value = delta << 1 ^ (0 - (delta >> 31));
+                previous = indices[i];
+                for (; value >= 0x80; value >>= 7)
+                    bytes[used++] = char(value | 0x80);
+                bytes[used++] = char(value);
+            }
+            out.write(std::string_view(bytes, used));
+        }
+    }
+
+private:
+    uint32_t previous = 0;
+};
+
+// Writes the arrays as a binary blob that can be viewed without parsing:
+//   32 byte header of little-endian uint32 values
+//     magic 'OBJA', version 1, vertex count, index count,
+//     vertex stride in bytes, index size in bytes (2 or 4),
+//     normal offset and texture coordinate offset in bytes within a
+//     vertex (0xFFFFFFFF if absent; positions are always at offset 0)
+//   vertex count * stride bytes of interleaved float32 vertex data
+//   index count * index size bytes of uint16 or uint32 indices
+// Indices are uint16 when there are fewer than 65536 vertices. Encoded
+// indices (see IndexEncoder) have an index size of 0.
+// With quantization the version is 2, and 48 more header bytes follow:
+//   uint32 texture coordinate encoding (TexcoordEncoding),
+//   float32 position offset x, y, z and scale x, y, z,
+//   float32 texture coordinate offset u, v and scale u, v, uint32 zero
+// Vertices are then int16 x, y, z, 0 normalized over offset +- scale,
+// int8 x, y of the octahedral normal, 2 bytes of zero, and a float16 or
+// unorm16 (over offset + scale) u, v. Absent attributes take no space.
+template <typename Real>
+void writeBinary(OutputBuffer& out, const VertexBuffer<Real>& vbo, const std::vector<unsigned int>& ebo,
+                 const Quantization* quantization = 0, bool encodeIndices = false)
+{
+    writeBinaryVertices(out, vbo, ebo.size(), quantization, encodeIndices);
+    if (encodeIndices)
+        IndexEncoder().encode(out, ebo.data(), ebo.size());
+    else
+        writeBinaryIndices(out, vbo, ebo.data(), ebo.size());
+}
+
+// Appends the levels of detail to the binary format: zero padding to a
+// multiple of 4 bytes, the magic 'LODS', a uint32 level count, the uint32
+// index count of every level, and then the indices of every level in the
+// index format of the header. Encoded indices restart from 0 for every level.
+template <typename Real>
+void writeBinaryLods(OutputBuffer& out, const VertexBuffer<Real>& vbo,
+                     const std::vector<std::vector<unsigned int>>& lods, bool encodeIndices = false)
+{
+    while (out.bytesWritten() % 4)
+        out.put('\0');
+    out.write("LODS");
+    writeLittleEndian(out, static_cast<uint32_t>(lods.size()));
+    for (const std::vector<unsigned int>& lod : lods)
+        writeLittleEndian(out, static_cast<uint32_t>(lod.size()));
+    for (const std::vector<unsigned int>& lod : lods) {
+        if (encodeIndices)
+            IndexEncoder().encode(out, lod.data(), lod.size());
+        else
+            writeBinaryIndices(out, vbo, lod.data(), lod.size());
+    }
+}
+
+// Appends the meshlet table to the binary format: zero padding to a multiple
+// of 4 bytes, the magic 'MSHL', a uint32 meshlet count, and for every
+// meshlet 4 uint32 (vertex offset and count, index offset and count) and 10
+// float32 (sphere center x, y, z and radius, box min x, y, z, max x, y, z)
+void writeBinaryMeshlets(OutputBuffer& out, const std::vector<Meshlet>& meshlets);
+
+// Appends the bounding box to the binary format: zero padding to a multiple
+// of 4 bytes, the magic 'BNDS' and 6 float32 (min x, y, z, max x, y, z)
+void writeBinaryBounds(OutputBuffer& out, const Bounds& bounds);
+
+// Hashes the bytes with the 64 bit xxHash (XXH64) algorithm
+uint64_t hashBytes(const void* data, size_t size, uint64_t seed = 0);
+
+// A command line argument's value: the text after '=' and its integer value
+struct Argument {
+    int value;
+    std::string text;
+};
+
+// Parses arguments into a dictionary and strips out any '=\d+' suffix into
+// the value of the dictionary entry
+void parseArguments(std::unordered_map<std::string, Argument>& parsedArgs,
+                    int numArgs, char** args, int offset = 1);
+
+// The library compiles these for float and double vertex data
+extern template bool objToJs<float>(std::string_view, VertexBuffer<float>&, std::vector<unsigned int>&,
+                                    bool, bool, unsigned int, ParseStats*, ParseContext<float>*);
+extern template void sortZX<float>(VertexBuffer<float>&, std::vector<unsigned int>&, unsigned int);
+extern template size_t weldVertices<float>(VertexBuffer<float>&, std::vector<unsigned int>&, double, unsigned int);
+extern template void transformVertices<float>(VertexBuffer<float>&, std::vector<unsigned int>&, const Transform&,
+                                              unsigned int);
+extern template size_t generateNormals<float>(VertexBuffer<float>&, std::vector<unsigned int>&, double, unsigned int);
+extern template void normalizeNormals<float>(VertexBuffer<float>&, unsigned int);
+extern template Bounds computeBounds<float>(const VertexBuffer<float>&, unsigned int);
+extern template void optimizeVertexFetch<float>(VertexBuffer<float>&, std::vector<unsigned int>&);
+extern template std::vector<Meshlet> buildMeshlets<float>(VertexBuffer<float>&, std::vector<unsigned int>&,
+                                                          unsigned int, unsigned int, unsigned int);
+extern template std::vector<std::vector<unsigned int>> buildLods<float>(const VertexBuffer<float>&,
+                                                                        const std::vector<unsigned int>&,
+                                                                        const std::vector<double>&, unsigned int);
+extern template void writeArrays<float>(OutputBuffer&, const VertexBuffer<float>&, const std::vector<unsigned int>&,
+                                        std::string_view, int, unsigned int);
+extern template void writeBinary<float>(OutputBuffer&, const VertexBuffer<float>&, const std::vector<unsigned int>&,
+                                        const Quantization*, bool);
+extern template bool objToJs<double>(std::string_view, VertexBuffer<double>&, std::vector<unsigned int>&,
+                                     bool, bool, unsigned int, ParseStats*, ParseContext<double>*);
+extern template void sortZX<double>(VertexBuffer<double>&, std::vector<unsigned int>&, unsigned int);
+extern template size_t weldVertices<double>(VertexBuffer<double>&, std::vector<unsigned int>&, double, unsigned int);
+extern template void transformVertices<double>(VertexBuffer<double>&, std::vector<unsigned int>&,
+                                               const Transform&, unsigned int);
+extern template size_t generateNormals<double>(VertexBuffer<double>&, std::vector<unsigned int>&, double, unsigned int);
+extern template void normalizeNormals<double>(VertexBuffer<double>&, unsigned int);
+extern template Bounds computeBounds<double>(const VertexBuffer<double>&, unsigned int);
+extern template void optimizeVertexFetch<double>(VertexBuffer<double>&, std::vector<unsigned int>&);
+extern template std::vector<Meshlet> buildMeshlets<double>(VertexBuffer<double>&, std::vector<unsigned int>&,
+                                                           unsigned int, unsigned int, unsigned int);
+extern template std::vector<std::vector<unsigned int>> buildLods<double>(const VertexBuffer<double>&,
+                                                                         const std::vector<unsigned int>&,
+                                                                         const std::vector<double>&, unsigned int);
+extern template void writeArrays<double>(OutputBuffer&, const VertexBuffer<double>&, const std::vector<unsigned int>&,
+                                         std::string_view, int, unsigned int);
+extern template void writeBinary<double>(OutputBuffer&, const VertexBuffer<double>&, const std::vector<unsigned int>&,
+                                         const Quantization*, bool);
+
+#endif // OBJ_TO_JS_ARRAY_H